@@ -260,7 +260,7 @@ void FnDecl::Emit(CodeGenerator *cg) {
         cg->GenBeginFunc(this);
         body->Emit(cg);
         cg->GenEndFunc();
-        cg->createCFG(begin);
+        cg->AddFunction(begin);
     }
 }
 
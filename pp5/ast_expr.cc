@@ -9,6 +9,14 @@
 #include "errors.h"
 #include "codegen.h"
 
+void Expr::EmitBranch(CodeGenerator *cg, bool whenTrue, const char *label) {
+    Emit(cg);
+    if (whenTrue)
+        cg->GenIfNZ(result, label);
+    else
+        cg->GenIfZ(result, label);
+}
+
 Type *EmptyExpr::CheckAndComputeResultType() { return Type::voidType; } 
 
 IntConstant::IntConstant(yyltype loc, int val) : Expr(loc) {
@@ -37,6 +45,10 @@ Type *BoolConstant::CheckAndComputeResultType() {
 void BoolConstant::Emit(CodeGenerator *cg) { 
     result = cg->GenLoadConstant(value);
 }
+void BoolConstant::EmitBranch(CodeGenerator *cg, bool whenTrue, const char *label) {
+    if (value == whenTrue)
+        cg->GenGoto(label);
+}
 
 StringConstant::StringConstant(yyltype loc, const char *val) : Expr(loc) {
     Assert(val != NULL);
@@ -116,8 +128,7 @@ void ArithmeticExpr::Emit(CodeGenerator *cg) {
         CompoundExpr::Emit(cg);
     else {
         right->Emit(cg);
-        Location *zero = cg->GenLoadConstant(0);
-        result = cg->GenBinaryOp("-", zero, right->result);
+        result = cg->GenUnaryOp("-", right->result);
     }
 }
 
@@ -127,24 +138,6 @@ Type* RelationalExpr::CheckAndComputeResultType() {
 	ReportErrorForIncompatibleOperands(lhs, rhs);
     return Type::boolType;
 }
-void RelationalExpr::Emit(CodeGenerator *cg) {
-    left->Emit(cg);
-    right->Emit(cg);
-    if (!strcmp(op->str(), "<")) {
-        result = cg->GenBinaryOp("<", left->result, right->result);
-    } else if (!strcmp(op->str(), ">")) {
-        result = cg->GenBinaryOp("<", right->result, left->result);
-    } else if (!strcmp(op->str(), "<=")) {
-        Location *less = cg->GenBinaryOp("<", left->result, right->result);
-        Location *eq  = cg->GenBinaryOp("==", left->result, right->result);
-        result =  cg->GenBinaryOp("||", less, eq);
-    } else if (!strcmp(op->str(), ">=")) {
-        Location *less = cg->GenBinaryOp("<", right->result, left->result);
-        Location *eq  = cg->GenBinaryOp("==", right->result, left->result);
-        result =  cg->GenBinaryOp("||", less, eq);
-    }
-}
-
 Type* EqualityExpr::CheckAndComputeResultType() {
    Type*lhs = left->CheckAndComputeResultType(), *rhs = right->CheckAndComputeResultType();
     if (!lhs->IsCompatibleWith(rhs) && !rhs->IsCompatibleWith(lhs))
@@ -154,14 +147,12 @@ Type* EqualityExpr::CheckAndComputeResultType() {
 void EqualityExpr::Emit(CodeGenerator *cg) {
     left->Emit(cg);
     right->Emit(cg);
-    if (left->CheckAndComputeResultType() == Type::stringType) 
+    if (left->CheckAndComputeResultType() == Type::stringType) {
         result = cg->GenBuiltInCall(StringEqual, left->result, right->result);
-    else
-        result = cg->GenBinaryOp("==", left->result, right->result);
-    if (!strcmp(op->str(), "!=")) {
-        Location *zero = cg->GenLoadConstant(0);
-        result = cg->GenBinaryOp("==", result, zero);
-    }
+        if (!strcmp(op->str(), "!="))
+            result = cg->GenUnaryOp("!", result);
+    } else
+        result = cg->GenBinaryOp(op->str(), left->result, right->result);
 }
 
 Type* LogicalExpr::CheckAndComputeResultType() {
@@ -171,13 +162,39 @@ Type* LogicalExpr::CheckAndComputeResultType() {
 	ReportErrorForIncompatibleOperands(lhs, rhs);
     return Type::boolType;
 }
+  // A value is only needed at the join, so the operands are tested by
+  // branches and 0 or 1 is loaded on the way out.
 void LogicalExpr::Emit(CodeGenerator *cg) {
-    if (left)
-	CompoundExpr::Emit(cg);
-    else {
+    if (!left) {
 	right->Emit(cg);
-	Location *zero = cg->GenLoadConstant(0);
-	result = cg->GenBinaryOp("==", right->result, zero);
+	result = cg->GenUnaryOp("!", right->result);
+	return;
+    }
+    char *falseLabel = cg->NewLabel(), *joinLabel = cg->NewLabel();
+    EmitBranch(cg, false, falseLabel);
+    result = cg->GenTempVar();
+    cg->GenAssign(result, cg->GenLoadConstant(1));
+    cg->GenGoto(joinLabel);
+    cg->GenLabel(falseLabel);
+    cg->GenAssign(result, cg->GenLoadConstant(0));
+    cg->GenLabel(joinLabel);
+}
+  // && is false, and || is true, as soon as either operand is;
+  // otherwise the left operand decides whether to test the right one.
+void LogicalExpr::EmitBranch(CodeGenerator *cg, bool whenTrue, const char *label) {
+    if (!left) {
+	right->EmitBranch(cg, !whenTrue, label);
+	return;
+    }
+    bool isAnd = !strcmp(op->str(), "&&");
+    if (isAnd != whenTrue) {
+	left->EmitBranch(cg, whenTrue, label);
+	right->EmitBranch(cg, whenTrue, label);
+    } else {
+	char *skip = cg->NewLabel();
+	left->EmitBranch(cg, !whenTrue, skip);
+	right->EmitBranch(cg, whenTrue, label);
+	cg->GenLabel(skip);
     }
 }
 
@@ -212,11 +229,9 @@ Type* This::CheckAndComputeResultType() {
    return enclosingClass->GetDeclaredType();
  }
 
-static Location *ThisLocation = new Location(fpRelative, 4, "this");
-
  void This::Emit(CodeGenerator *cg) {
    if (!result)
-    result = ThisLocation;
+    result = cg->GetThis();
  }
  
    
@@ -29,6 +29,12 @@ class Expr : public Stmt
     virtual Type* CheckAndComputeResultType() = 0;
     Location *result;
     Location *GetResult() { return result; }
+
+    // Emits a jump to label that is taken when the expression's value
+    // is whenTrue, falling through otherwise. The default computes the
+    // value and tests it; no result is left for the logical operators,
+    // which become branches alone.
+    virtual void EmitBranch(CodeGenerator *cg, bool whenTrue, const char *label);
 };
 
 /* This node type is used for those places where an expression is optional.
@@ -71,6 +77,7 @@ class BoolConstant : public Expr
     BoolConstant(yyltype loc, bool val);
     Type *CheckAndComputeResultType();
     void Emit(CodeGenerator *cg);
+    void EmitBranch(CodeGenerator *cg, bool whenTrue, const char *label);
 };
 
 class StringConstant : public Expr 
@@ -131,7 +138,6 @@ class RelationalExpr : public CompoundExpr
   public:
     RelationalExpr(Expr *lhs, Operator *op, Expr *rhs) : CompoundExpr(lhs,op,rhs) {}
     Type* CheckAndComputeResultType();
-    void Emit(CodeGenerator *cg);
 };
 
 class EqualityExpr : public CompoundExpr 
@@ -151,6 +157,7 @@ class LogicalExpr : public CompoundExpr
     const char *GetPrintNameForNode() { return "LogicalExpr"; }
     Type* CheckAndComputeResultType();
     void Emit(CodeGenerator *cg);
+    void EmitBranch(CodeGenerator *cg, bool whenTrue, const char *label);
 };
 
 class AssignExpr : public CompoundExpr 
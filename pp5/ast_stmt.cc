@@ -36,10 +36,11 @@ void Program::Emit() {
     }
     CodeGenerator *cg = new CodeGenerator();
     decls->EmitAll(cg);
-    //cg->kColoring();  // Calls kcoloring here after all intergraphs is made 
 
-    if (ReportError::NumErrors() == 0)
+    if (ReportError::NumErrors() == 0) {
+        cg->AllocateRegisters();  // needs every function, to go callees first
         cg->DoFinalCodeGen();
+    }
 }
 
 StmtBlock::StmtBlock(List<VarDecl*> *d, List<Stmt*> *s) {
@@ -80,26 +81,27 @@ void ForStmt::Check() {
     step->Check();
     ConditionalStmt::Check();
 }
+  // Loops are rotated: the test is emitted twice, once as a guard that
+  // skips the loop and once at the bottom branching back to the top, so
+  // each iteration takes a single branch.
 void ForStmt::Emit(CodeGenerator *cg) {
     init->Emit(cg);
     char *topLoop = cg->NewLabel();
     afterLoopLabel = cg->NewLabel();
+    test->EmitBranch(cg, false, afterLoopLabel);
     cg->GenLabel(topLoop);
-    test->Emit(cg);
-    cg->GenIfZ(test->result, afterLoopLabel);
     body->Emit(cg);
     step->Emit(cg);
-    cg->GenGoto(topLoop);
+    test->EmitBranch(cg, true, topLoop);
     cg->GenLabel(afterLoopLabel);
 }
 void WhileStmt::Emit(CodeGenerator *cg) {
     char *topLoop = cg->NewLabel();
     afterLoopLabel = cg->NewLabel();
+    test->EmitBranch(cg, false, afterLoopLabel);
     cg->GenLabel(topLoop);
-    test->Emit(cg);
-    cg->GenIfZ(test->result, afterLoopLabel);
     body->Emit(cg);
-    cg->GenGoto(topLoop);
+    test->EmitBranch(cg, true, topLoop);
     cg->GenLabel(afterLoopLabel);
 }
 
@@ -113,9 +115,8 @@ void IfStmt::Check() {
     if (elseBody) elseBody->Check();
 }
 void IfStmt::Emit(CodeGenerator *cg) {
-    test->Emit(cg);
     char *afterElse, *elseL = cg->NewLabel();
-    cg->GenIfZ(test->result, elseL);
+    test->EmitBranch(cg, false, elseL);
     body->Emit(cg);
     if (elseBody) {
 	afterElse = cg->NewLabel();
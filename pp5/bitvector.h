@@ -0,0 +1,120 @@
+/* File: bitvector.h
+ * -----------------
+ * The BitVector class is a fixed-size set of small integers packed
+ * into machine words. It is used by the dataflow analyses, where every
+ * Location in a function is given a dense id and sets of Locations
+ * (live-in, live-out, gen, kill) become bit vectors.
+ *
+ * All of the set operations work a word at a time, and the ones used
+ * inside a fixpoint loop report whether they changed the receiver so
+ * the caller doesn't need a separate equality test.
+ */
+
+#ifndef _H_bitvector
+#define _H_bitvector
+
+#include <vector>
+#include "utility.h"  // for Assert()
+
+class BitVector {
+
+  private:
+    typedef unsigned int Word;
+    static const int BitsPerWord = 32;
+
+    std::vector<Word> words;
+    int numBits;
+
+    static int WordsFor(int n) { return (n + BitsPerWord - 1) / BitsPerWord; }
+
+  public:
+           // Create a new empty set able to hold 0..n-1
+    BitVector(int n = 0) : words(WordsFor(n), 0), numBits(n) {}
+
+           // Discards the contents and makes room for 0..n-1
+    void Resize(int n)
+        { numBits = n; words.assign(WordsFor(n), 0); }
+
+    int NumBits() const  { return numBits; }
+    int NumWords() const { return words.size(); }
+
+    void Set(int i)
+        { Assert(i >= 0 && i < numBits);
+          words[i / BitsPerWord] |= Word(1) << (i % BitsPerWord); }
+    void Reset(int i)
+        { Assert(i >= 0 && i < numBits);
+          words[i / BitsPerWord] &= ~(Word(1) << (i % BitsPerWord)); }
+    bool Test(int i) const
+        { Assert(i >= 0 && i < numBits);
+          return (words[i / BitsPerWord] >> (i % BitsPerWord)) & 1; }
+
+    void ClearAll()
+        { for (int w = 0; w < NumWords(); w++) words[w] = 0; }
+    void SetAll()
+        { for (int w = 0; w < NumWords(); w++) words[w] = ~Word(0);
+          if (numBits % BitsPerWord)
+              words[NumWords()-1] &= (Word(1) << (numBits % BitsPerWord)) - 1; }
+
+    bool IsEmpty() const
+        { for (int w = 0; w < NumWords(); w++) if (words[w]) return false;
+          return true; }
+
+    bool operator==(const BitVector &other) const
+        { return numBits == other.numBits && words == other.words; }
+    bool operator!=(const BitVector &other) const
+        { return !(*this == other); }
+
+           // this = this | other. Returns true if any bit was added.
+    bool UnionWith(const BitVector &other)
+        { Assert(numBits == other.numBits);
+          Word added = 0;
+          for (int w = 0; w < NumWords(); w++) {
+              Word old = words[w];
+              words[w] |= other.words[w];
+              added |= words[w] ^ old;
+          }
+          return added != 0; }
+
+           // this = this & other
+    void IntersectWith(const BitVector &other)
+        { Assert(numBits == other.numBits);
+          for (int w = 0; w < NumWords(); w++) words[w] &= other.words[w]; }
+
+           // this = this & ~other
+    void Subtract(const BitVector &other)
+        { Assert(numBits == other.numBits);
+          for (int w = 0; w < NumWords(); w++) words[w] &= ~other.words[w]; }
+
+           // this = gen | (x & ~kill), the usual gen/kill transfer
+           // function. Returns true if the result differs from the
+           // previous contents.
+    bool Transfer(const BitVector &x, const BitVector &gen, const BitVector &kill)
+        { Assert(numBits == x.numBits && numBits == gen.numBits && numBits == kill.numBits);
+          Word diff = 0;
+          for (int w = 0; w < NumWords(); w++) {
+              Word result = gen.words[w] | (x.words[w] & ~kill.words[w]);
+              diff |= result ^ words[w];
+              words[w] = result;
+          }
+          return diff != 0; }
+
+           // Returns the smallest member >= from, or -1 if there is none.
+           // Used to walk the members:
+           //     for (int i = set.NextSet(0); i != -1; i = set.NextSet(i+1))
+    int NextSet(int from) const
+        { if (from >= numBits) return -1;
+          int w = from / BitsPerWord;
+          Word cur = words[w] & (~Word(0) << (from % BitsPerWord));
+          while (true) {
+              if (cur) return w * BitsPerWord + __builtin_ctz(cur);
+              if (++w >= NumWords()) return -1;
+              cur = words[w];
+          } }
+
+    int Count() const
+        { int n = 0;
+          for (int w = 0; w < NumWords(); w++) n += __builtin_popcount(words[w]);
+          return n; }
+};
+
+#endif
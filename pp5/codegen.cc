@@ -11,9 +11,10 @@
 #include "mips.h"
 #include "ast_decl.h"
 #include "errors.h"
+#include "ssa.h"
 #include <vector>
 #include <string>
-#include <stack>
+#include <algorithm>
   
 using namespace std;
   
@@ -21,476 +22,1256 @@ CodeGenerator::CodeGenerator()
 {
   code = new List<Instruction*>();
   labels = new unordered_map<string, Instruction*>;
-  deletedCode = new vector<Instruction*>;
-  interGraph = new List<Location*>();
+  locations = new vector<Location*>;
+  flowGraph = NULL;
+  interGraph = NULL;
+  spillTemps = new unordered_set<Location*>;
   curGlobalOffset = 0;
+  thisLoc = NULL;
+  for (int i = 0; i < NumArgRegs; i++)
+  {
+    char name[8];
+    sprintf(name, "$a%d", i);
+    Location *reg = new Location(fpRelative, 0, name);
+    reg->SetPrecolored(Mips::Register(Mips::a0 + i));
+    argRegs.Append(reg);
+  }
 }
 
-void CodeGenerator::createCFG(int begin)
+void CodeGenerator::AddFunction(int begin)
 {
-    BeginFunc* bf = dynamic_cast<BeginFunc*>(code->Nth(begin));
-    Assert(bf); //always start at BeginFunc
-    Goto* gt;
-    IfZ* iz;
-    EndFunc* ef;
-    Return* ret;
-    /*
-    dynamic casts to paste in as needed
-    LoadConstant* lc = dynamic_cast<LoadConstant*>(code->Nth(//XXX));
-    LoadStringConstant* lcs = dynamic_cast<LoadStringConstant*>(code->Nth(//XXX));
-    LoadLabel* ll = dynamic_cast<LoadLabel*>(code->Nth(//XXX));
-    Assign* assign = dynamic_cast<Assign*>(code->Nth(//XXX));
-    Load* load = dynamic_cast<Load*>(code->Nth(//XXX));
-    Store* store = dynamic_cast<Store*>(code->Nth(//XXX));
-    BinaryOp* bo = dynamic_cast<BinaryOp*>(code->Nth(//XXX));
-    Label* label = dynamic_cast<Label*>(code->Nth(//XXX));
-    Goto* gt = dynamic_cast<Goto*>(code->Nth(//XXX));
-    IfZ* iz = dynamic_cast<IfZ*>(code->Nth(//XXX));
-    EndFunc* ef = dynamic_cast<EndFunc*>(code->Nth(//XXX));
-    Return* ret = dynamic_cast<Return*>(code->Nth(//XXX));
-    PushParam* pp = dynamic_cast<PushParam*>(code->Nth(//XXX));
-    RemoveParams* rp = dynamic_cast<RemoveParams*>(code->Nth(//XXX));
-    LCall* lCall = dynamic_cast<LCall*>(code->Nth(//XXX));
-    ACall* aCall = dynamic_cast<ACall*>(code->Nth(//XXX));
-    VTable* vt = dynamic_cast<VTable*>(code->Nth(//XXX));
-    */
-    for (int i = begin; i < code->NumElements(); i++)
+  Assert(dynamic_cast<BeginFunc*>(code->Nth(begin)));
+  functionBegins.push_back(begin);
+}
+
+/* Method: AllocateRegisters
+ * -------------------------
+ * Runs createCFG on every function added so far, callees before their
+ * callers (a postorder walk of the call graph), so each LCall can be
+ * told exactly which registers its target may change and the caller
+ * only saves live values in those. The functions are moved to the end
+ * of the code one at a time as they are allocated, which is where
+ * createCFG expects the function it works on. Calls whose target isn't
+ * allocated yet (recursion) and ACalls, whose target isn't known, are
+ * assumed to clobber everything.
+ */
+void CodeGenerator::AllocateRegisters()
+{
+    // split the code into the functions and everything else
+    List<Instruction*> *all = code;
+    code = new List<Instruction*>;
+    int n = functionBegins.size();
+    vector<vector<Instruction*> > bodies(n);
+    unordered_map<string, int> functionFor;     // label -> function
+    int next = 0;
+    for (int f = 0; f < n; f++)
     {
-        //If EndFunc, finished
-        ef = dynamic_cast<EndFunc*>(code->Nth(i));
-        if (ef)
-            break;
-            
-        //If Goto, find label, add to edges
-        gt = dynamic_cast<Goto*>(code->Nth(i));
-        if (gt)
+        int begin = functionBegins[f];
+        for (; next < begin - 1; next++)
+            code->Append(all->Nth(next));
+        Label* label = dynamic_cast<Label*>(all->Nth(begin - 1));
+        Assert(label);
+        functionFor[label->getLabel()] = f;
+        for (; !dynamic_cast<EndFunc*>(all->Nth(next)); next++)
+            bodies[f].push_back(all->Nth(next));
+        bodies[f].push_back(all->Nth(next++));
+    }
+    for (; next < all->NumElements(); next++)
+        code->Append(all->Nth(next));
+    delete all;
+    functionBegins.clear();
+
+    vector<vector<int> > callees(n);
+    for (int f = 0; f < n; f++)
+        for (int i = 0; i < bodies[f].size(); i++)
         {
-            string s = gt->getLabel();
-            gt->addEdge((*labels)[s]);
-            continue;
+            LCall* call = dynamic_cast<LCall*>(bodies[f][i]);
+            if (call && functionFor.count(call->getLabel()))
+                callees[f].push_back(functionFor[call->getLabel()]);
         }
-        
-        //If IfZ, find label, add next instruction and label to edges
-        iz = dynamic_cast<IfZ*>(code->Nth(i));
-        if (iz)
-        {
-            string s = iz->getLabel();
-            iz->addEdge((*labels)[s]);
-            
-            iz->addEdge(code->Nth(i+1));
+
+    vector<int> order, state(n, 0);     // state: 0 new, 1 on the stack, 2 done
+    for (int root = 0; root < n; root++)
+    {
+        if (state[root])
             continue;
+        vector<pair<int, int> > stack(1, make_pair(root, 0));
+        state[root] = 1;
+        while (!stack.empty())
+        {
+            int f = stack.back().first;
+            if (stack.back().second < callees[f].size())
+            {
+                int g = callees[f][stack.back().second++];
+                if (!state[g])
+                {
+                    state[g] = 1;
+                    stack.push_back(make_pair(g, 0));
+                }
+                continue;
+            }
+            state[f] = 2;
+            order.push_back(f);
+            stack.pop_back();
         }
-        Return* ret = dynamic_cast<Return*>(code->Nth(i));
-        if (ret)
+    }
+
+    // The builtins in SysCallCodeGen only write v0 and a0-a2
+    unordered_map<string, unsigned int> clobbersOf;
+    for (int b = 0; b < NumBuiltIns; b++)
+        clobbersOf[BuiltInLabel(BuiltIn(b))] = (1u << Mips::v0) | (0x7u << Mips::a0);
+
+    for (int i = 0; i < order.size(); i++)
+    {
+        vector<Instruction*> &body = bodies[order[i]];
+        for (int j = 0; j < body.size(); j++)
         {
-            continue;
+            LCall* call = dynamic_cast<LCall*>(body[j]);
+            if (call && clobbersOf.count(call->getLabel()))
+                call->SetClobbers(clobbersOf[call->getLabel()]);
         }
-        code->Nth(i)->addEdge(code->Nth(i+1)); //if instruction doesnt fit any above, add next instruction
+        int begin = code->NumElements() + 1;
+        for (int j = 0; j < body.size(); j++)
+            code->Append(body[j]);
+        clobbersOf[functionName(begin)] = createCFG(begin);
     }
-    do //when dead code is removed, livenessAnalysis must restart
+}
+
+/* Method: createCFG
+ * -----------------
+ * Allocates registers for the function whose BeginFunc is at begin, the
+ * last one in the code. Returns the mask of registers it may change:
+ * the ones it computes in, those of its callees, and the scratch and
+ * argument registers, which every function is free to use.
+ */
+unsigned int CodeGenerator::createCFG(int begin)
+{
+    BeginFunc* bf = dynamic_cast<BeginFunc*>(code->Nth(begin));
+    Assert(bf); //always start at BeginFunc
+    simplifyControlFlow(begin);
+    flowGraph = new FlowGraph(code, begin, labels);
+    numberLocations(begin);
+    optimizeSSA(begin);
+    deadCodeElimination(begin);
+    sinkParameterLoads(begin);
+
+    spillTemps->clear();
+    while (true) //spill code changes liveness, so build and color again
     {
         livenessAnalysis(begin);
-        for (int i = begin; i < code->NumElements(); i++)
+        interferenceGraph(begin);
+        coalesceMoves(begin);
+        vector<Location*> spills;
+        kColoring(spills);
+        delete interGraph;
+        interGraph = NULL;
+        if (spills.empty())
+            break;
+
+        insertSpillCode(begin, spills);
+        delete flowGraph;
+        flowGraph = new FlowGraph(code, begin, labels);
+        numberLocations(begin);
+    }
+
+    unsigned int calleeSaved = 0;
+    for (int l = 0; l < locations->size(); l++)
+        if (Mips::IsCalleeSaved((*locations)[l]->GetRegister()))
+            calleeSaved |= 1u << (*locations)[l]->GetRegister();
+    assignStackSlots(begin);
+    removeCoalescedMoves(begin);
+    bf->SetCalleeSaved(calleeSaved);
+
+    bool makesCalls = false, readsParamSlots = false;
+    for (int i = begin; i < code->NumElements(); i++)
+    {
+        Instruction* instruction = code->Nth(i);
+        if (dynamic_cast<CallInstr*>(instruction))
+            makesCalls = true;
+        List<Location*> used = instruction->GenSet();
+        used.AppendAll(instruction->KillSet());
+        for (int j = 0; j < used.NumElements(); j++)
+            if (used.Nth(j)->GetSegment() == fpRelative && !used.Nth(j)->GetRegister()
+                && used.Nth(j)->GetOffset() >= OffsetToFirstParam)
+                readsParamSlots = true;
+    }
+    bf->SetFrameUse(makesCalls, readsParamSlots);
+
+    unsigned int clobbers = (1u << Mips::v0) | (1u << Mips::v1) | (0xfu << Mips::a0);
+    for (int l = 0; l < locations->size(); l++)
+        if (!Mips::IsCalleeSaved((*locations)[l]->GetRegister()))
+            clobbers |= 1u << (*locations)[l]->GetRegister();
+    for (int i = begin; i < code->NumElements(); i++)
+        if (dynamic_cast<CallInstr*>(code->Nth(i)))
+            clobbers |= dynamic_cast<CallInstr*>(code->Nth(i))->GetClobbers();
+    PrintDebug("regalloc", "%s: clobbers %08x", functionName(begin).c_str(), clobbers);
+    locations->clear();
+    delete flowGraph;
+    flowGraph = NULL;
+    return clobbers;
+}
+
+string CodeGenerator::functionName(int begin)
+{
+    Label* fnLabel = begin > 0 ? dynamic_cast<Label*>(code->Nth(begin-1)) : NULL;
+    return fnLabel ? fnLabel->getLabel() : "?";
+}
+
+  // Locations that always go through memory: globals, which every
+  // function can see, and locations the allocator has spilled
+static bool InMemory(Location *loc)
+{
+    return loc->GetSegment() == gpRelative || loc->IsSpilled();
+}
+
+  // The registers kColoring hands out: t0-t9 and s0-s7, plus $fp when
+  // the frame pointer is omitted and fpRelative means $sp-relative
+static unsigned int AllocatableRegs()
+{
+    unsigned int regs = ((1u << Mips::NumGeneralPurposeRegs) - 1) << Mips::t0;
+    if (IsOptionOn("omit-frame-pointer"))
+        regs |= 1u << Mips::fp;
+    return regs;
+}
+
+  // The copy of a stack parameter's incoming slot that GenBeginFunc
+  // loads it from
+static bool IsIncomingParam(Location *loc)
+{
+    return loc->IsSpilled() && loc->GetSegment() == fpRelative
+        && loc->GetOffset() >= CodeGenerator::OffsetToFirstParam;
+}
+
+static bool SameSlot(Location *a, Location *b)
+{
+    return a->GetSegment() == b->GetSegment() && a->GetOffset() == b->GetOffset()
+        && !a->IsReference() && !b->IsReference();
+}
+
+/* Method: numberLocations
+ * -----------------------
+ * Gives every Location used or defined in the function starting at
+ * begin a dense id (0..n-1) and builds the gen/kill bit vectors of
+ * each instruction, so the dataflow passes can work on bit vectors
+ * instead of lists. A Location shared between functions (the argument
+ * registers a0-a3) keeps a stale id from an earlier function, so an id
+ * only counts if it maps back to the same Location in the table.
+ * Globals and spilled locations are left unnumbered: they are never
+ * given a register and always go through memory.
+ */
+void CodeGenerator::numberLocations(int begin)
+{
+    locations->clear();
+    for (int i = begin; i < code->NumElements(); i++)
+    {
+        List<Location*> used = code->Nth(i)->GenSet();
+        used.AppendAll(code->Nth(i)->KillSet());
+        for (int j = 0; j < used.NumElements(); j++)
         {
-            // // cout << code->Nth(i)->TACString() << "\n----\n";
-            // // cout << "OutSet" << endl; 
-            for (int j = 0; j < code->Nth(i)->outSet.NumElements(); j++)
+            Location* loc = used.Nth(j);
+            if (InMemory(loc))
+                continue;
+            int id = loc->GetId();
+            if (id < 0 || id >= locations->size() || (*locations)[id] != loc)
             {
-                // // cout << code->Nth(i)->outSet.Nth(j)->GetName() << ' ';
-            } 
-            // // cout << endl << "KillSet" << endl;
-            for (int j = 0; j < code->Nth(i)->KillSet().NumElements(); j++)
-            {
-                // // cout << code->Nth(i)->KillSet().Nth(j)->GetName() << ' ';
-            }
-            // // cout << endl << "InSet" << endl;
-            for (int j = 0; j < code->Nth(i)->inSet.NumElements(); j++)
-            {
-                // // cout << code->Nth(i)->inSet.Nth(j)->GetName() << ' ';
+                loc->SetId(locations->size());
+                locations->push_back(loc);
             }
-            // // cout << "\n\n";
         }
     }
-    while (deadCodeAnalysis(begin));
 
-    interferenceGraph(begin);
+    int numLocations = locations->size();
+    for (int i = begin; i < code->NumElements(); i++)
+    {
+        Instruction* instruction = code->Nth(i);
+        instruction->liveIn.Resize(numLocations);
+        instruction->liveOut.Resize(numLocations);
+        instruction->gen.Resize(numLocations);
+        instruction->kill.Resize(numLocations);
+        List<Location*> genSet = instruction->GenSet();
+        List<Location*> killSet = instruction->KillSet();
+        for (int j = 0; j < genSet.NumElements(); j++)
+            if (!InMemory(genSet.Nth(j)))
+                instruction->gen.Set(genSet.Nth(j)->GetId());
+        for (int j = 0; j < killSet.NumElements(); j++)
+            if (!InMemory(killSet.Nth(j)))
+                instruction->kill.Set(killSet.Nth(j)->GetId());
+    }
+}
+
+/* Method: livenessAnalysis
+ * ------------------------
+ * Solves liveness over the basic blocks of the current function and
+ * then walks each block bottom-up once to give every instruction its
+ * own live-in/live-out sets.
+ */
+void CodeGenerator::livenessAnalysis(int begin)
+{
+    BeginFunc* bf = dynamic_cast<BeginFunc*>(code->Nth(begin));
+    Assert(bf);
+
+    LivenessProblem liveness(locations->size());
+    liveness.Solve(flowGraph);
 
-    // // cout << "interGraph" << endl;
-    for (int i = 0; i < interGraph->NumElements(); i++)
+    for (int b = 0; b < flowGraph->NumBlocks(); b++)
     {
-        // // cout << "---------- " << interGraph->Nth(i)->GetName() << " --------------" << endl;
-        for (int j = 0; j < interGraph->Nth(i)->getNumEdges(); j++)
+        BasicBlock* block = flowGraph->Nth(b);
+        BitVector live = liveness.out[b];
+        for (int i = block->code.NumElements() - 1; i >= 0; i--)
         {
-            // // cout << interGraph->Nth(i)->getEdge(j)->GetName() << endl;
+            Instruction* instruction = block->code.Nth(i);
+            instruction->liveOut = live;
+            live.Transfer(live, instruction->gen, instruction->kill);
+            instruction->liveIn = live;
         }
     }
 
-    for (int i = 0; i < interGraph->NumElements(); i++)
+    // The emitters and the interference graph still want lists
+    for (int i = begin; i < code->NumElements(); i++)
     {
-        // // cout << interGraph->Nth(i)->GetName() << ' ' << interGraph->Nth(i) << endl;
+        Instruction* instruction = code->Nth(i);
+        instruction->inSet.Clear();
+        instruction->outSet.Clear();
+        for (int j = instruction->liveIn.NextSet(0); j != -1; j = instruction->liveIn.NextSet(j+1))
+            instruction->inSet.Append((*locations)[j]);
+        for (int j = instruction->liveOut.NextSet(0); j != -1; j = instruction->liveOut.NextSet(j+1))
+            instruction->outSet.Append((*locations)[j]);
     }
-    // cout << "BETWEEN" << endl;
-    kColoring();
 
+    PrintDebug("liveness-stats", "%s: %d instructions, %d blocks, %d locations, %d block visits, %ld bits processed",
+               functionName(begin).c_str(), code->NumElements() - begin,
+               flowGraph->NumBlocks(), (int)locations->size(), liveness.iterations,
+               liveness.bitsProcessed);
+}
 
-    interGraph->Clear();
-    deletedCode->clear();
+  // The label a Goto or conditional branch jumps to, "" for anything else
+static string branchTarget(Instruction *instruction)
+{
+    if (dynamic_cast<Goto*>(instruction))
+        return dynamic_cast<Goto*>(instruction)->getLabel();
+    if (dynamic_cast<CondBranch*>(instruction))
+        return dynamic_cast<CondBranch*>(instruction)->getLabel();
+    return "";
 }
 
-void CodeGenerator::livenessAnalysis(int begin)
+  // True if label is among the labels starting at body[i], so control
+  // falling through to body[i] ends up at it
+static bool fallsInto(vector<Instruction*> &body, int i, const string &label)
 {
-    Instruction* instruction;
-    Instruction* edge;
+    for (; i < body.size() && dynamic_cast<Label*>(body[i]); i++)
+        if (dynamic_cast<Label*>(body[i])->getLabel() == label)
+            return true;
+    return false;
+}
 
-    BeginFunc* bf = dynamic_cast<BeginFunc*>(code->Nth(begin));
-    Assert(bf);
-    bool changed = true;
-    List<Location*> emptyList;
+/* Method: simplifyControlFlow
+ * ---------------------------
+ * Cleans up the control flow statement lowering leaves behind, working
+ * on the Tac list before any graph is built, until nothing changes:
+ * a branch to a label that only leads on to a Goto jumps straight to
+ * the Goto's target (threading through empty blocks), a branch to the
+ * code right after it goes, and so does a Goto a conditional branch
+ * skips over, the branch being negated to jump to the Goto's target.
+ * Then code no path from BeginFunc reaches is removed, and so are the
+ * labels no branch uses, which merges the blocks on either side.
+ */
+void CodeGenerator::simplifyControlFlow(int begin)
+{
+    vector<Instruction*> body;
     for (int i = begin; i < code->NumElements(); i++)
-        code->Nth(i)->inSet = emptyList; //inSets must be recomputed every time liveness is called
-        
+        body.push_back(code->Nth(i));
+    int before = body.size();
+    bool changed = true;
     while (changed)
     {
         changed = false;
+        unordered_map<string, int> at;      // label -> index in body
+        for (int i = 0; i < body.size(); i++)
+            if (dynamic_cast<Label*>(body[i]))
+                at[dynamic_cast<Label*>(body[i])->getLabel()] = i;
+
+        for (int i = 0; i < body.size(); i++)
+        {
+            string target = branchTarget(body[i]), next = target;
+            if (target.empty())
+                continue;
+            unordered_set<string> seen;     // a loop of Gotos ends the chain
+            while (seen.insert(next).second)
+            {
+                Assert(at.count(next));
+                int j = at[next];
+                while (dynamic_cast<Label*>(body[j]))
+                    j++;
+                if (!dynamic_cast<Goto*>(body[j]))
+                    break;
+                next = dynamic_cast<Goto*>(body[j])->getLabel();
+            }
+            if (next == target)
+                continue;
+            if (dynamic_cast<Goto*>(body[i]))
+                dynamic_cast<Goto*>(body[i])->SetLabel(next.c_str());
+            else
+                dynamic_cast<CondBranch*>(body[i])->SetLabel(next.c_str());
+            changed = true;
+        }
 
-        for (int i = begin; i < code->NumElements(); i++) //for each TAC in CFG:
+        vector<Instruction*> kept;
+        for (int i = 0; i < body.size(); i++)
         {
-            List<Location*> outSet;
-            instruction = code->Nth(i);
-            for (int j = 0; j < instruction->getNumEdges(); j++) //Out[TAC] = Union(In[Succ(TAC)])
+            string target = branchTarget(body[i]);
+            CondBranch* branch = dynamic_cast<CondBranch*>(body[i]);
+            Goto* skipped = i + 1 < body.size() ? dynamic_cast<Goto*>(body[i+1]) : NULL;
+            if (!target.empty() && fallsInto(body, i + 1, target))
+                changed = true;
+            else if (branch && skipped && fallsInto(body, i + 2, target))
             {
-                edge = instruction->getEdge(j);
-                bool deleted = false;
-                for (int k = 0; k < deletedCode->size(); k++)
+                kept.push_back(branch->Negated(skipped->getLabel().c_str()));
+                i++;
+                changed = true;
+            }
+            else
+                kept.push_back(body[i]);
+        }
+        body = kept;
+
+        at.clear();
+        for (int i = 0; i < body.size(); i++)
+            if (dynamic_cast<Label*>(body[i]))
+                at[dynamic_cast<Label*>(body[i])->getLabel()] = i;
+        vector<bool> reached(body.size(), false);
+        vector<int> worklist(1, 0);
+        reached[0] = true;
+        while (!worklist.empty())
+        {
+            int i = worklist.back();
+            worklist.pop_back();
+            vector<int> succs;
+            string target = branchTarget(body[i]);
+            if (!target.empty())
+                succs.push_back(at[target]);
+            if (!dynamic_cast<Goto*>(body[i]) && !dynamic_cast<Return*>(body[i])
+                && !dynamic_cast<EndFunc*>(body[i]))
+                succs.push_back(i + 1);
+            for (int j = 0; j < succs.size(); j++)
+                if (!reached[succs[j]])
                 {
-                    if (edge == (*deletedCode)[k])
-                    {
-                        deleted = true;
-                        break;
-                    }
+                    reached[succs[j]] = true;
+                    worklist.push_back(succs[j]);
                 }
-                if (deleted)
+        }
+        unordered_set<string> used;
+        for (int i = 0; i < body.size(); i++)
+            if (reached[i] && !branchTarget(body[i]).empty())
+                used.insert(branchTarget(body[i]));
+        kept.clear();
+        for (int i = 0; i < body.size(); i++)
+        {
+            Label* label = dynamic_cast<Label*>(body[i]);
+            if ((reached[i] || dynamic_cast<EndFunc*>(body[i]))
+                && !(label && !used.count(label->getLabel())))
+                kept.push_back(body[i]);
+        }
+        if (kept.size() != body.size())
+            changed = true;
+        body = kept;
+    }
+    replaceFunctionCode(begin, body);
+
+    PrintDebug("cfg", "%s: %d instructions, was %d", functionName(begin).c_str(),
+               (int)body.size(), before);
+}
+
+/* Method: insertPreheaders
+ * ------------------------
+ * Gives each loop a preheader: a block of its own that the loop is only
+ * entered from, for invariant code to be hoisted into. Rotated loops
+ * fall into their header from the block holding the guard, which also
+ * branches past the loop, so most of them need one. The new block is a
+ * label placed just before the header, which the code falling into the
+ * header now goes through; branches from outside the loop to the header
+ * are pointed at it instead. If the block before the header belongs to
+ * the loop and falls into it, a Goto keeps that edge out of the
+ * preheader.
+ */
+void CodeGenerator::insertPreheaders(int begin)
+{
+    unordered_map<Instruction*, vector<Instruction*> > before;  // header label -> new code
+    int added = 0;
+    List<Loop*> *loops = flowGraph->Loops();
+    for (int l = 0; l < loops->NumElements(); l++)
+    {
+        Loop* loop = loops->Nth(l);
+        BasicBlock* header = loop->header;
+        vector<BasicBlock*> outside;
+        for (int p = 0; p < header->preds.NumElements(); p++)
+            if (!loop->contains.Test(header->preds.Nth(p)->id))
+                outside.push_back(header->preds.Nth(p));
+        if (outside.size() == 1 && outside[0]->succs.NumElements() == 1)
+            continue;
+        Label* headerLabel = dynamic_cast<Label*>(header->code.Nth(0));
+        Assert(headerLabel);
+
+        char *preheader = NewLabel();
+        for (int p = 0; p < outside.size(); p++)
+        {
+            Instruction* last = outside[p]->code.Nth(outside[p]->code.NumElements() - 1);
+            if (branchTarget(last) != headerLabel->getLabel())
+                continue;
+            if (dynamic_cast<Goto*>(last))
+                dynamic_cast<Goto*>(last)->SetLabel(preheader);
+            else
+                dynamic_cast<CondBranch*>(last)->SetLabel(preheader);
+        }
+        BasicBlock* prev = header->id > 0 ? flowGraph->Nth(header->id - 1) : NULL;
+        if (prev && loop->contains.Test(prev->id))
+        {
+            Instruction* last = prev->code.Nth(prev->code.NumElements() - 1);
+            if (!dynamic_cast<Goto*>(last) && !dynamic_cast<Return*>(last))
+                before[headerLabel].push_back(new Goto(headerLabel->getLabel().c_str()));
+        }
+        Label* label = new Label(preheader);
+        (*labels)[preheader] = label;
+        before[headerLabel].push_back(label);
+        added++;
+    }
+    if (!added)
+        return;
+
+    vector<Instruction*> body;
+    for (int i = begin; i < code->NumElements(); i++)
+    {
+        if (before.count(code->Nth(i)))
+            body.insert(body.end(), before[code->Nth(i)].begin(), before[code->Nth(i)].end());
+        body.push_back(code->Nth(i));
+    }
+    replaceFunctionCode(begin, body);
+    delete flowGraph;
+    flowGraph = new FlowGraph(code, begin, labels);
+    numberLocations(begin);
+    PrintDebug("licm", "%s: added %d preheaders", functionName(begin).c_str(), added);
+}
+
+/* Method: optimizeSSA
+ * -------------------
+ * Takes the function into SSA form for constant and copy propagation,
+ * value numbering, loop-invariant code motion and range analysis (see
+ * ssa.h) and back out. Loops get their preheaders first, while it's
+ * still plain Tac. Value numbering can leave phis whose arguments all
+ * became the same, so copies are propagated a second time after it.
+ * Folded branches and removed bounds checks leave dead blocks and jumps
+ * to the next instruction behind, so the control flow is simplified
+ * again before the graph and the Location numbering are rebuilt for
+ * the passes that follow.
+ */
+void CodeGenerator::optimizeSSA(int begin)
+{
+    insertPreheaders(begin);
+    SSAForm ssa(flowGraph, locations, labels);
+    int phis = ssa.Build();
+    int constants = ssa.PropagateConstants();
+    int copies = ssa.PropagateCopies();
+    int redundant = ssa.NumberValues();
+    copies += ssa.PropagateCopies();
+    int hoisted = ssa.HoistInvariants();
+    int checks = ssa.EliminateChecks();
+    ssa.Destroy();
+    rebuildFromBlocks(begin);
+    if (constants || checks)
+    {
+        simplifyControlFlow(begin);
+        delete flowGraph;
+        flowGraph = new FlowGraph(code, begin, labels);
+    }
+    numberLocations(begin);
+    PrintDebug("ssa", "%s: %d phis, %d constants folded, %d copies propagated, %d redundant, "
+               "%d hoisted, %d checks removed", functionName(begin).c_str(), phis, constants,
+               copies, redundant, hoisted, checks);
+}
+
+/* Method: deadCodeElimination
+ * ---------------------------
+ * Mark-and-sweep dead code removal in one pass. Every instruction with
+ * an effect besides writing its destination (stores, calls, returns,
+ * branches) or that writes a Location living in memory (globals) is a
+ * root; marking follows the use-def chains from reaching definitions
+ * back to the instructions that produced the operands, so a whole chain
+ * of dead computations goes at once instead of one link per liveness
+ * round. Whatever is left unmarked is tombstoned and swept out of the
+ * code list and the flow graph.
+ */
+void CodeGenerator::deadCodeElimination(int begin)
+{
+    ReachingDefsProblem reaching(flowGraph, locations->size());
+    reaching.Solve(flowGraph);
+
+    // use-def chains: the def ids each instruction's operands may read
+    unordered_map<Instruction*, vector<int> > useDefs;
+    for (int b = 0; b < flowGraph->NumBlocks(); b++)
+    {
+        BasicBlock* block = flowGraph->Nth(b);
+        BitVector cur = reaching.in[b];
+        for (int i = 0; i < block->code.NumElements(); i++)
+        {
+            Instruction* instruction = block->code.Nth(i);
+            for (int l = instruction->gen.NextSet(0); l != -1; l = instruction->gen.NextSet(l+1))
+            {
+                BitVector r = cur;
+                r.IntersectWith(reaching.defsOf[l]);
+                for (int d = r.NextSet(0); d != -1; d = r.NextSet(d+1))
+                    useDefs[instruction].push_back(d);
+            }
+            reaching.Step(instruction, cur);
+        }
+    }
+
+    vector<Instruction*> worklist;
+    for (int i = begin; i < code->NumElements(); i++)
+    {
+        Instruction* instruction = code->Nth(i);
+        instruction->removed = instruction->isPure() && !instruction->kill.IsEmpty();
+        if (!instruction->removed)
+            worklist.push_back(instruction);
+    }
+    while (!worklist.empty())
+    {
+        Instruction* instruction = worklist.back();
+        worklist.pop_back();
+        vector<int> &operands = useDefs[instruction];
+        for (int j = 0; j < operands.size(); j++)
+        {
+            Instruction* def = reaching.defs[operands[j]];
+            if (def->removed)
+            {
+                def->removed = false;
+                worklist.push_back(def);
+            }
+        }
+    }
+
+    vector<Instruction*> kept;
+    for (int i = begin; i < code->NumElements(); i++)
+        if (!code->Nth(i)->removed)
+            kept.push_back(code->Nth(i));
+    int numRemoved = code->NumElements() - begin - kept.size();
+    replaceFunctionCode(begin, kept);
+    flowGraph->Compact();
+
+    PrintDebug("dce", "%s: removed %d instructions, %d definitions, %d block visits",
+               functionName(begin).c_str(), numRemoved,
+               (int)reaching.defs.size(), reaching.iterations);
+}
+
+  // The function being allocated is always at the end of code, so its
+  // instructions are replaced by popping them and appending the new ones
+void CodeGenerator::replaceFunctionCode(int begin, vector<Instruction*> &body)
+{
+    while (code->NumElements() > begin)
+        code->RemoveAt(code->NumElements() - 1);
+    for (int i = 0; i < body.size(); i++)
+        code->Append(body[i]);
+}
+
+  // Lays the function's code back out from the blocks of flowGraph
+  // (after a pass moved instructions between them) and rebuilds the
+  // graph over the new order.
+void CodeGenerator::rebuildFromBlocks(int begin)
+{
+    vector<Instruction*> body;
+    for (int b = 0; b < flowGraph->NumBlocks(); b++)
+    {
+        BasicBlock* block = flowGraph->Nth(b);
+        for (int i = 0; i < block->code.NumElements(); i++)
+            body.push_back(block->code.Nth(i));
+    }
+    replaceFunctionCode(begin, body);
+    delete flowGraph;
+    flowGraph = new FlowGraph(code, begin, labels);
+}
+
+/* Method: interferenceGraph
+ * -------------------------
+ * Builds the interference graph of the current function from the
+ * liveness bit vectors: the values live on entry all interfere with
+ * each other, and each value an instruction defines interferes with
+ * everything live after it. The exception is the source of a copy,
+ * which holds the same value as the destination and so is free to
+ * share its register. Also notes which values are live across a call.
+ */
+void CodeGenerator::interferenceGraph(int begin)
+{
+    interGraph = new InterferenceGraph(locations->size());
+    callClobbers.assign(locations->size(), 0);
+    BitVector &entry = code->Nth(begin)->liveIn;
+    for (int i = entry.NextSet(0); i != -1; i = entry.NextSet(i+1))
+    {
+        interGraph->AddNode(i);
+        for (int j = entry.NextSet(i+1); j != -1; j = entry.NextSet(j+1))
+            interGraph->AddEdge(i, j);
+    }
+    for (int i = begin + 1; i < code->NumElements(); i++)
+    {
+        Instruction* instruction = code->Nth(i);
+        BitVector &kill = instruction->kill;
+        BitVector &liveOut = instruction->liveOut;
+        int src = dynamic_cast<Assign*>(instruction) ? instruction->gen.NextSet(0) : -1;
+        CallInstr* call = dynamic_cast<CallInstr*>(instruction);
+        if (call)
+        {
+            for (int j = liveOut.NextSet(0); j != -1; j = liveOut.NextSet(j+1))
+                if (!kill.Test(j))
+                    callClobbers[j] |= call->GetClobbers();
+        }
+        for (int j = liveOut.NextSet(0); j != -1; j = liveOut.NextSet(j+1))
+            interGraph->AddNode(j);
+        for (int d = kill.NextSet(0); d != -1; d = kill.NextSet(d+1))
+            for (int j = liveOut.NextSet(0); j != -1; j = liveOut.NextSet(j+1))
+                if (j != src)
+                    interGraph->AddEdge(d, j);
+    }
+
+    PrintDebug("regalloc", "%s: interference graph has %d nodes, %d edges",
+               functionName(begin).c_str(),
+               (int)interGraph->Nodes().size(), interGraph->NumEdges());
+}
+
+
+  // Representative of l's coalesced node
+int CodeGenerator::aliasOf(int l)
+{
+    while (alias[l] != l)
+        l = alias[l] = alias[alias[l]];
+    return l;
+}
+
+/* Method: coalesceMoves
+ * ---------------------
+ * Conservative coalescing of the copies in the current function. The
+ * two sides of a copy that don't interfere are merged into one node
+ * when that can't make the graph harder to color: either the merged
+ * node has fewer than K neighbours of significant degree (>= K), the
+ * Briggs test, or every neighbour of one side already interferes with
+ * the other or has insignificant degree, the George test. Copies in
+ * deeper loops are tried first. A merged node gets one register, which
+ * turns its copies into no-ops for removeCoalescedMoves to delete.
+ */
+void CodeGenerator::coalesceMoves(int begin)
+{
+    const int K = __builtin_popcount(AllocatableRegs());
+    alias.resize(locations->size());
+    for (int l = 0; l < alias.size(); l++)
+        alias[l] = l;
+
+    vector<pair<int, Instruction*> > moves;
+    for (int b = 0; b < flowGraph->NumBlocks(); b++)
+    {
+        BasicBlock* block = flowGraph->Nth(b);
+        for (int i = 0; i < block->code.NumElements(); i++)
+        {
+            Instruction* instruction = block->code.Nth(i);
+            if (dynamic_cast<Assign*>(instruction) && !instruction->gen.IsEmpty()
+                && !instruction->kill.IsEmpty())
+                moves.push_back(make_pair(-block->loopDepth, instruction));
+        }
+    }
+    stable_sort(moves.begin(), moves.end(),
+                [](const pair<int, Instruction*> &a, const pair<int, Instruction*> &b)
+                { return a.first < b.first; });
+
+    int merged = 0;
+    for (int i = 0; i < moves.size(); i++)
+    {
+        int a = aliasOf(moves[i].second->kill.NextSet(0));
+        int b = aliasOf(moves[i].second->gen.NextSet(0));
+        if ((*locations)[b]->IsPrecolored())
+            swap(a, b);     // a fixed register can only absorb the other side
+        if (a == b || interGraph->Interferes(a, b) || !interGraph->HasNode(a)
+            || !interGraph->HasNode(b) || (*locations)[b]->IsPrecolored())
+            continue;
+
+        int significant = 0;
+        const vector<int> &adjA = interGraph->Neighbors(a);
+        const vector<int> &adjB = interGraph->Neighbors(b);
+        for (int j = 0; j < adjA.size(); j++)
+            if (interGraph->Degree(adjA[j]) >= K)
+                significant++;
+        for (int j = 0; j < adjB.size(); j++)
+            if (interGraph->Degree(adjB[j]) >= K && !interGraph->Interferes(a, adjB[j]))
+                significant++;
+        bool briggs = significant < K;
+        bool george = true;
+        for (int j = 0; j < adjB.size() && george; j++)
+            george = interGraph->Degree(adjB[j]) < K || interGraph->Interferes(a, adjB[j]);
+        if (!briggs && !george)
+            continue;
+
+        interGraph->Merge(a, b);
+        alias[b] = a;
+        merged++;
+    }
+    PrintDebug("regalloc", "%s: coalesced %d of %d moves", functionName(begin).c_str(),
+               merged, (int)moves.size());
+}
+
+/* Method: sinkParameterLoads
+ * --------------------------
+ * GenBeginFunc loads each parameter passed on the stack right after
+ * BeginFunc. A load that survived dead code elimination is moved down
+ * to the nearest block that dominates every use and def of the
+ * parameter, just before the first of them there (or at the bottom of
+ * the block if it has none), so paths that never touch the parameter
+ * don't pay for it and its register is free until then. The target is
+ * kept out of loops, where the load would run again on every trip and
+ * could clobber a value assigned to the parameter.
+ */
+void CodeGenerator::sinkParameterLoads(int begin)
+{
+    BasicBlock* entry = flowGraph->Entry();
+    vector<Assign*> loads;
+    for (int i = 0; i < entry->code.NumElements(); i++)
+    {
+        Assign* load = dynamic_cast<Assign*>(entry->code.Nth(i));
+        if (load && IsIncomingParam(load->GetSrc()))
+            loads.push_back(load);
+    }
+
+    int sunk = 0;
+    for (int i = 0; i < loads.size(); i++)
+    {
+        Assign* load = loads[i];
+        int param = load->kill.NextSet(0);
+        BasicBlock* target = NULL;
+        for (int b = 0; b < flowGraph->NumBlocks(); b++)
+        {
+            BasicBlock* block = flowGraph->Nth(b);
+            if (!flowGraph->IsReachable(block))
+                continue;
+            for (int j = 0; j < block->code.NumElements(); j++)
+            {
+                Instruction* instruction = block->code.Nth(j);
+                if (instruction == load || (!instruction->gen.Test(param)
+                                            && !instruction->kill.Test(param)))
                     continue;
-                    
-                for (int k = 0; k < edge->inSet.NumElements(); k++) //Union every elem into outSet
-                {
-                    Location* elem = edge->inSet.Nth(k);
-                    bool found = false;
-                    for (int l = 0; l < outSet.NumElements(); l++)  //check to see if elem is already in outSet
-                    {
-                        if (outSet.Nth(l) == elem)
-                        {
-                            found = true;
-                            break;
-                        }
-                    }
-                    if (!found)
-                        outSet.Append(elem); //if elem isn't already in outSet, add it
-                }
+                while (target && !flowGraph->Dominates(target, block))
+                    target = target->idom;
+                if (!target)
+                    target = block;
+                break;
             }
-            instruction->outSet = outSet;
-            //In'[TAC] = Out[TAC] - Kill[TAC] + Gen[TAC]
-            List<Location*> inPrimeSet = outSet; //= Out[TAC]
-            List<Location*> killSet = instruction->KillSet();
-            List<Location*> genSet = instruction->GenSet();
+        }
+        while (target && target->loopDepth > 0)
+            target = target->idom;
+        if (!target)
+            continue;
 
-            for (int j = 0; j < inPrimeSet.NumElements(); j++) //- Kill[TAC]
+        // before the first mention, or the branch ending the block
+        int at = target->code.NumElements();
+        Instruction* last = target->code.Nth(at - 1);
+        if (dynamic_cast<Goto*>(last) || dynamic_cast<CondBranch*>(last) || dynamic_cast<Return*>(last)
+            || dynamic_cast<EndFunc*>(last))
+            at--;
+        for (int j = 0; j < target->code.NumElements(); j++)
+        {
+            Instruction* instruction = target->code.Nth(j);
+            if (instruction != load && (instruction->gen.Test(param) || instruction->kill.Test(param)))
             {
-                for (int k = 0; k < killSet.NumElements(); k++)
-                {
-                    if (inPrimeSet.Nth(j) == killSet.Nth(k))
-                    {
-                        inPrimeSet.RemoveAt(j);
-                        j--; //so elements dont get skipped
-                        break;
-                    }
-                }
+                at = j;
+                break;
             }
-            for (int j = 0; j < genSet.NumElements(); j++) //+ Gen[TAC]
+        }
+        if (target == entry)
+        {
+            int from = 0;
+            while (entry->code.Nth(from) != load)
+                from++;
+            if (at <= from + 1)
+                continue;
+            entry->code.RemoveAt(from);
+            at--;
+        }
+        else
+        {
+            for (int j = 0; j < entry->code.NumElements(); j++)
+                if (entry->code.Nth(j) == load)
+                    entry->code.RemoveAt(j);
+        }
+        target->code.InsertAt(load, at);
+        sunk++;
+    }
+    if (sunk)
+        rebuildFromBlocks(begin);
+    PrintDebug("regalloc", "%s: sank %d parameter loads", functionName(begin).c_str(), sunk);
+}
+
+/* Method: assignStackSlots
+ * ------------------------
+ * GenLocalVariable only hands out provisional offsets, one per local
+ * and temp, to tell their slots apart. Once registers are assigned the
+ * only locals that still touch memory are the ones left without a
+ * register and the ones saved around a call, and only they get a real
+ * slot. Slots are colored like registers: a slot is live from a store
+ * to the last load before the next store, values saved around a call
+ * are live at that call, and two provisional slots that are never live
+ * together share a real one. The frame shrinks to the slots used.
+ */
+void CodeGenerator::assignStackSlots(int begin)
+{
+    BeginFunc* bf = dynamic_cast<BeginFunc*>(code->Nth(begin));
+    unordered_map<int, int> slotOf;     // provisional offset -> dense id
+    vector<int> offsets;                // dense id -> provisional offset
+    unordered_set<Location*> locals;
+    unordered_map<Instruction*, List<Location*> > saved;  // around each call
+    for (int i = begin; i < code->NumElements(); i++)
+    {
+        Instruction* instruction = code->Nth(i);
+        List<Location*> used = instruction->GenSet();
+        used.AppendAll(instruction->KillSet());
+        CallInstr* call = dynamic_cast<CallInstr*>(instruction);
+        if (call)
+        {
+            List<Location*> live = call->LiveAcrossCall();
+            for (int j = 0; j < live.NumElements(); j++)
+                if (live.Nth(j)->GetRegister() && !Mips::IsCalleeSaved(live.Nth(j)->GetRegister()))
+                    saved[call].Append(live.Nth(j));
+            used.AppendAll(saved[call]);
+        }
+        for (int j = 0; j < used.NumElements(); j++)
+        {
+            Location* loc = used.Nth(j);
+            if (loc->GetSegment() != fpRelative || loc->GetOffset() > OffsetToFirstLocal)
+                continue;
+            locals.insert(loc);
+            if (!slotOf.count(loc->GetOffset()))
             {
-                bool found = false;
-                for (int k = 0; k < inPrimeSet.NumElements(); k++)
-                {
-                    if (inPrimeSet.Nth(k) == genSet.Nth(j))
-                    {
-                        found = true;
-                        break;
-                    }
-                }
-                
-                if (!found)
-                    inPrimeSet.Append(genSet.Nth(j));
+                slotOf[loc->GetOffset()] = offsets.size();
+                offsets.push_back(loc->GetOffset());
             }
-            
-            List<Location*> tempInPrimeSet = inPrimeSet; 
-            
-            bool foundInOutSet = false;
-            bool setsAreDifferent = false;
-            for(int j=0; j< instruction->inSet.NumElements(); j++)
+        }
+    }
+
+    // gen/kill over the slots: a local without a register reads and
+    // writes its slot wherever it is used and defined
+    int numSlots = offsets.size();
+    for (int i = begin; i < code->NumElements(); i++)
+    {
+        Instruction* instruction = code->Nth(i);
+        instruction->gen.Resize(numSlots);
+        instruction->kill.Resize(numSlots);
+        List<Location*> genSet = instruction->GenSet();
+        List<Location*> killSet = instruction->KillSet();
+        for (int j = 0; j < genSet.NumElements(); j++)
+            if (locals.count(genSet.Nth(j)) && !genSet.Nth(j)->GetRegister())
+                instruction->gen.Set(slotOf[genSet.Nth(j)->GetOffset()]);
+        for (int j = 0; j < killSet.NumElements(); j++)
+            if (locals.count(killSet.Nth(j)) && !killSet.Nth(j)->GetRegister())
+                instruction->kill.Set(slotOf[killSet.Nth(j)->GetOffset()]);
+    }
+    LivenessProblem liveness(numSlots);
+    liveness.Solve(flowGraph);
+
+    InterferenceGraph slots(numSlots);
+    for (int b = 0; b < flowGraph->NumBlocks(); b++)
+    {
+        BasicBlock* block = flowGraph->Nth(b);
+        BitVector live = liveness.out[b];
+        for (int i = block->code.NumElements() - 1; i >= 0; i--)
+        {
+            Instruction* instruction = block->code.Nth(i);
+            List<Location*> &around = saved[instruction];
+            for (int j = 0; j < around.NumElements(); j++)
             {
-            	for(int k=0; k<tempInPrimeSet.NumElements(); k++)
-            	{
-            		if(instruction->inSet.Nth(j) == tempInPrimeSet.Nth(k))
-            		{
-            			tempInPrimeSet.RemoveAt(k); 
-            			foundInOutSet = true; 
-            			break;
-            		}
-            	}
-            	
-            	if(foundInOutSet)
-            	{
-            		foundInOutSet = false; 
-            		continue; 
-            	}
-            	else
-            	{
-            		setsAreDifferent = true;
-            		break;
-            	}
-            }            
-            
-            if(setsAreDifferent || tempInPrimeSet.NumElements() != 0)
+                int s = slotOf[around.Nth(j)->GetOffset()];
+                slots.AddNode(s);
+                for (int l = live.NextSet(0); l != -1; l = live.NextSet(l+1))
+                    slots.AddEdge(s, l);
+                for (int k = 0; k < j; k++)
+                    slots.AddEdge(s, slotOf[around.Nth(k)->GetOffset()]);
+            }
+            int src = dynamic_cast<Assign*>(instruction) ? instruction->gen.NextSet(0) : -1;
+            for (int k = instruction->kill.NextSet(0); k != -1; k = instruction->kill.NextSet(k+1))
             {
-            	instruction->inSet = inPrimeSet; 
-            	changed = true; 
+                slots.AddNode(k);
+                for (int l = live.NextSet(0); l != -1; l = live.NextSet(l+1))
+                    if (l != src)
+                        slots.AddEdge(k, l);
             }
-            
+            live.Transfer(live, instruction->gen, instruction->kill);
+            for (int l = live.NextSet(0); l != -1; l = live.NextSet(l+1))
+                slots.AddNode(l);
         }
     }
+    BitVector &entryLive = liveness.in[flowGraph->Entry()->id];  // read before written
+    for (int a = entryLive.NextSet(0); a != -1; a = entryLive.NextSet(a+1))
+        for (int b = entryLive.NextSet(a+1); b != -1; b = entryLive.NextSet(b+1))
+            slots.AddEdge(a, b);
+
+    // greedy: the lowest frame slot none of the neighbours has taken
+    vector<int> color(numSlots, -1);
+    int frameSlots = 0;
+    const vector<int> &nodes = slots.Nodes();
+    for (int i = 0; i < nodes.size(); i++)
+    {
+        int n = nodes[i];
+        vector<bool> taken(frameSlots + 1, false);
+        const vector<int> &neighbors = slots.Neighbors(n);
+        for (int j = 0; j < neighbors.size(); j++)
+            if (color[neighbors[j]] >= 0)
+                taken[color[neighbors[j]]] = true;
+        int c = 0;
+        while (taken[c])
+            c++;
+        color[n] = c;
+        frameSlots = max(frameSlots, c + 1);
+    }
+
+    for (unordered_set<Location*>::iterator it = locals.begin(); it != locals.end(); ++it)
+    {
+        int s = slotOf[(*it)->GetOffset()];
+        if (color[s] >= 0)
+            (*it)->SetOffset(OffsetToFirstLocal - color[s]*VarSize);
+    }
+    PrintDebug("regalloc", "%s: %d stack slots for %d locals (was %d bytes)",
+               functionName(begin).c_str(), frameSlots, numSlots, bf->GetFrameSize());
+    bf->SetFrameSize(frameSlots*VarSize);
 }
 
-bool CodeGenerator::deadCodeAnalysis(int begin)
+/* Method: removeCoalescedMoves
+ * ----------------------------
+ * Once the function is colored, a copy whose two sides ended up in the
+ * same register does nothing, so it is dropped. So does one between two
+ * locations left in the same stack slot (a parameter that got no
+ * register is loaded from where the caller put it to that same place).
+ */
+void CodeGenerator::removeCoalescedMoves(int begin)
 {
-    Instruction* instruction;
-    bool altered = false;
+    vector<Instruction*> kept;
+    int removed = 0;
     for (int i = begin; i < code->NumElements(); i++)
     {
-        instruction = code->Nth(i);
-        Assert(instruction);
-        if (instruction->isDead())
+        Instruction* instruction = code->Nth(i);
+        Assign* move = dynamic_cast<Assign*>(instruction);
+        if (move && (move->GetDst()->GetRegister()
+                     ? move->GetDst()->GetRegister() == move->GetSrc()->GetRegister()
+                     : !move->GetSrc()->GetRegister() && SameSlot(move->GetDst(), move->GetSrc())))
         {
-            // // cout << "removing" << endl;
-            code->RemoveAt(i);
-            // // cout << instruction->TACString() << endl;
-            i--; //to prevent skipping instructions
-            altered = true;
-            deletedCode->push_back(instruction);
+            instruction->removed = true;
+            removed++;
         }
-        
+        else
+            kept.push_back(instruction);
     }
-    return altered;
+    replaceFunctionCode(begin, kept);
+    flowGraph->Compact();
+    PrintDebug("regalloc", "%s: eliminated %d moves", functionName(begin).c_str(), removed);
 }
 
-void CodeGenerator::interferenceGraph(int begin)
+/* Method: kColoring
+ * -----------------
+ * Chaitin-Briggs coloring of the interference graph with the K general
+ * purpose registers t0-t9/s0-s7 (and $fp with -fomit-frame-pointer).
+ * Simplify keeps two worklists: nodes of degree < K, which can always
+ * be colored, and the rest. Removing a node lowers its neighbours'
+ * current degree, moving them to the low list when they drop below K.
+ * When only high-degree nodes remain, the one that is cheapest to spill
+ * relative to its degree is pushed anyway, optimistically (Briggs): its
+ * neighbours may still end up sharing colors. Select pops the stack and
+ * gives each node the lowest register not in the mask of registers its
+ * colored neighbours hold. A t register that none of the calls the
+ * value lives across clobbers comes first, since it costs nothing to
+ * use; failing that, values live across a call take s0-s7, which calls
+ * preserve. The precolored argument registers are never simplified or
+ * recolored, they only show up in their neighbours' masks. Nodes that
+ * find no register are returned in spills.
+ */
+void CodeGenerator::kColoring(vector<Location*> &spills)
 {
-    List<Location*> killSet, inSet, outSet;
-    inSet = code->Nth(begin)->inSet;
-    interGraph->AppendAll(inSet);
-    interGraph->Unique();
-    for (int i = 0; i < inSet.NumElements(); i++)
+    const unsigned int allocatable = AllocatableRegs();
+    const int K = __builtin_popcount(allocatable);
+    const vector<int> &nodes = interGraph->Nodes();
+    vector<double> cost = spillCosts();
+    for (int l = 0; l < alias.size(); l++)
+        if (aliasOf(l) != l)
+        {
+            cost[aliasOf(l)] += cost[l];
+            callClobbers[aliasOf(l)] |= callClobbers[l];
+        }
+
+    vector<int> degree(locations->size(), 0);
+    vector<bool> onStack(locations->size(), false);
+    vector<int> low, high, select;
+    for (int i = 0; i < nodes.size(); i++)
     {
-        for (int j = i + 1; j < inSet.NumElements(); j++)
+        Location* loc = (*locations)[nodes[i]];
+        if (loc->IsPrecolored())
         {
-            inSet.Nth(i)->addEdge(inSet.Nth(j));
+            // the argument registers keep their own, outside the
+            // colors handed out here
+            onStack[nodes[i]] = true;
+            continue;
         }
+        loc->SetRegister(Mips::zero);
+        degree[nodes[i]] = interGraph->Degree(nodes[i]);
+        if (degree[nodes[i]] < K)
+            low.push_back(nodes[i]);
+        else
+            high.push_back(nodes[i]);
     }
-    for (int i = begin + 1; i < code->NumElements(); i++)
+
+    while (!low.empty() || !high.empty())
     {
-        outSet = code->Nth(i)->outSet;
-        killSet = code->Nth(i)->KillSet();
-        interGraph->AppendAll(outSet);
-        interGraph->Unique();
-        for (int j = 0; j < killSet.NumElements(); j++)
+        int n;
+        if (!low.empty())
         {
-            for (int k = 0; k < outSet.NumElements(); k++)
-            {
-                if (outSet.Nth(k) != killSet.Nth(j))
+            n = low.back();
+            low.pop_back();
+        }
+        else
+        {
+            int best = 0;
+            for (int i = 1; i < high.size(); i++)
+                if (cost[high[i]] / degree[high[i]] < cost[high[best]] / degree[high[best]])
+                    best = i;
+            n = high[best];
+            high[best] = high.back();
+            high.pop_back();
+        }
+        onStack[n] = true;
+        select.push_back(n);
+
+        const vector<int> &neighbors = interGraph->Neighbors(n);
+        for (int i = 0; i < neighbors.size(); i++)
+        {
+            int m = neighbors[i];
+            if (onStack[m] || degree[m]-- != K)
+                continue;
+            // m just dropped below K: move it from high to low
+            for (int j = 0; j < high.size(); j++)
+                if (high[j] == m)
                 {
-                    // // cout << outSet.Nth(k)->GetName() << " <-> " << killSet.Nth(j)->GetName() << endl;
-                    outSet.Nth(k)->addEdge(killSet.Nth(j));
+                    high[j] = high.back();
+                    high.pop_back();
+                    break;
                 }
-            }
+            low.push_back(m);
         }
     }
-    //// cout << "GRAPH" << endl;
-    for (int i = 0; i < interGraph->NumElements() - 1; i++)
-    {
-        //// cout << interGraph->Nth(i) << endl;
-        Assert(interGraph->Nth(i) != interGraph->Nth(i+1));
-    }
-    //// cout << "ENDGRAPH" << endl;
-}
-
-
-void CodeGenerator::kColoring()
-{
-      // // cout << "before" << endl;
- 	  bool canColor = false; 			// Indicator to keep loop going until coloring found
- 	  stack<Location*> degree;			// Stack to keep track of Nodes with degree under K 
- 	  List<Location*> removed; 			// Keep track of locations that have been "removed" from interGraph 
- 	  if (interGraph->NumElements() == 0)
- 	    return;
- 	  while(!canColor)
- 	  {
- 	  	int temp; 
- 	  	while((temp = findNode(removed)) != -1) // degree satisfies 
- 	  	{
- 	  		Location* satisfies = interGraph->Nth(temp); 	
- 	  		removed.Append(satisfies); 					// Add node to removed
-            // // cout << satisfies->GetName() << " REMOVED" << endl; 
- 	  		degree.push(satisfies);  // push node to stack to be setReg later 
- 	  	}
- 	  	// // cout << degree.top()->GetName() << endl;
- 	  	if(removed.NumElements() == interGraph->NumElements()) // Means K Colorable .. stack is full of all nodes 
-		{
-			Location *node = degree.top(); 
-			Assert(node);
-			degree.pop(); 
-			node->SetRegister(Mips::Register(8));	// Set first reg to t0 
-            if (!strcmp(node->GetName(), "this"))
-                node->SetRegister(Mips::Register(3));
-            // // cout << node->GetName() << "=" << node->GetRegister() << endl;
-			bool foundSameReg = false;  // Indicator for whether found loc with same reg 
-			while(!degree.empty())		
-			{
-				node = degree.top(); 
-				degree.pop(); 
-
-
-                
-                if (!strcmp(node->GetName(), "this"))
-                {
-                    node->SetRegister(Mips::Register(3));
-                    // // cout << node->GetName() << "=" << node->GetRegister() << endl;
-                    continue;
-                }
-				for(int i=8; i<=25; i++) // best way to filter out gp regs? 
-				{
-					for(int j=0; j<node->getNumEdges(); j++)
-					{
-						if(node->getEdge(j)->GetRegister() == Mips::Register(i))	// Check with edge nodes if any adjacent have the same reg 
-						{
-							foundSameReg = true; 
-							break; 
-						}
-					}
-					if(foundSameReg)
-					{
-						foundSameReg = false; 
-						continue; 
-					}
-					else 
-					{
-                        node->SetRegister(Mips::Register(i)); 
-                        // // cout << node->GetName() << "=" << node->GetRegister() << endl;
-                        break;
-					}				
-				}
-
-				if(node->GetRegister() == Mips::Register(0))
-				{
-					// // cout<<"Could not find K coloring which should not be happening. Fuck. "<<endl; 
-				}
-				else
-				{
-					// // cout<<"It Works"<<endl;
-				}
-			}
-			
-			canColor = true; 
-		
-		}
-		else // Cant be Kcolored
-		{	
-			int index = findMaxKNode(removed); 	//Returns largest degree index 
-			// cout << interGraph->Nth(index) << endl;
-			if(index != -1)
-			{
-				// // cout<<"Good index .. spilling "<<interGraph->Nth(index)->GetName()<<endl; 
-				removed.Append(interGraph->Nth(index));	// Append to remove list 
-			//	Mips mips; 
-			//	mips.SpillRegister(interGraph->Nth(index),interGraph->Nth(index)->GetRegister()); 	// Not sure if this is right but spill the largest degreed reg 
-			}
-			else
-			{
-				exit(1);// // cout<<"Bad Index"<<endl; 	// Checker 
-			}
-		}
- 	 }
- 	 // // cout << "after" << endl;
-}
-
-
-int CodeGenerator::findNode(List<Location*> removed)
-{
-	int count = 0; 
-	for(int i=0; i<interGraph->NumElements(); i++)
-	{
-		int numEdges = interGraph->Nth(i)->getNumEdges();
-		
-		if(wasRemoved(interGraph->Nth(i),removed))      // Has this location been removed already  
-			continue;
-			 
-		if(numEdges < Mips::NumGeneralPurposeRegs) // if it is already below the max num then it can return here 
-		{
-			return i; 
-		}
-		else
-		{
-			for(int j= 0; j<numEdges; j++)	
-			{
-				if(!wasRemoved(interGraph->Nth(i)->getEdge(j),removed))	// Checks if it was not removed .. if so, add to count 
-					count++;
-			}
-			
-			if(count < Mips::NumGeneralPurposeRegs)	// Check count
-				return i;
-		}
-	}
-	
-	return -1; 
-}
-
-int CodeGenerator::findMaxKNode(List<Location*> removed) //Like find node but for max node 
-{
-	int max = -1;
-	int count = 0;
-	int index = -1;  
-	for(int i=0; i<interGraph->NumElements(); i++)
-	{
-        if (wasRemoved(interGraph->Nth(i), removed))
+
+    while (!select.empty())
+    {
+        int n = select.back();
+        select.pop_back();
+        unsigned int forbidden = 0;
+        const vector<int> &neighbors = interGraph->Neighbors(n);
+        for (int i = 0; i < neighbors.size(); i++)
+            forbidden |= 1u << (*locations)[neighbors[i]]->GetRegister();
+        unsigned int free = ~forbidden & allocatable;
+        unsigned int calleeSaved = (0xffu << Mips::s0) | (1u << Mips::fp);
+        unsigned int preferred = free & ~calleeSaved & ~callClobbers[n];
+        if (!preferred && (callClobbers[n] & ~calleeSaved))
+            preferred = free & calleeSaved;
+        if (preferred)
+            free = preferred;
+        if (free)
+            (*locations)[n]->SetRegister(Mips::Register(__builtin_ctz(free)));
+    }
+
+    // coalesced locations share their representative's register, and
+    // an uncolored spill temp just stays in its home slot
+    for (int l = 0; l < locations->size(); l++)
+    {
+        int r = aliasOf(l);
+        if (!interGraph->HasNode(r))
             continue;
-        count = 0;
-		for(int j=0; j<interGraph->Nth(i)->getNumEdges(); j++)
-		{
-			if(wasRemoved(interGraph->Nth(i)->getEdge(j),removed))
-				continue; 
-			else
-				count ++; 
-		}
-		
-		if(count > max)
-		{
-			max = count; 
-			index = i; 
-		}	
-	}
-
-	return index; 
-}
-
-bool CodeGenerator::wasRemoved(Location* check,List<Location*> removed)	// Checks to see if location exists in removed list 
-{
-	for(int i=0; i<removed.NumElements() ; i++)
-	{
-		if(check == removed.Nth(i))
-		{
-			return true;
-		}
-	}
-	
-	return false; 
+        Location* loc = (*locations)[l];
+        if (r != l)
+            loc->SetRegister((*locations)[r]->GetRegister());
+        if (!loc->GetRegister() && !spillTemps->count(loc))
+            spills.push_back(loc);
+    }
+}
+
+/* Method: spillCosts
+ * ------------------
+ * Estimated cost of keeping each Location of the current function in
+ * memory: its uses and defs, each weighted by 10^(loop depth) of the
+ * block it is in. The temps made by insertSpillCode must stay in
+ * registers, so they cost "infinitely" much.
+ */
+vector<double> CodeGenerator::spillCosts()
+{
+    vector<double> cost(locations->size(), 0);
+    for (int b = 0; b < flowGraph->NumBlocks(); b++)
+    {
+        BasicBlock* block = flowGraph->Nth(b);
+        double weight = 1;
+        for (int d = 0; d < block->loopDepth; d++)
+            weight *= 10;
+        for (int i = 0; i < block->code.NumElements(); i++)
+        {
+            Instruction* instruction = block->code.Nth(i);
+            for (int l = instruction->gen.NextSet(0); l != -1; l = instruction->gen.NextSet(l+1))
+                cost[l] += weight;
+            for (int l = instruction->kill.NextSet(0); l != -1; l = instruction->kill.NextSet(l+1))
+                cost[l] += weight;
+        }
+    }
+    for (int l = 0; l < locations->size(); l++)
+        if (spillTemps->count((*locations)[l]))
+            cost[l] = 1e30;
+    return cost;
+}
+
+/* Method: insertSpillCode
+ * -----------------------
+ * Moves the spilled locations to memory for good. Each instruction that
+ * reads one gets a fresh temp loaded from the stack slot just before it,
+ * and each one that writes one writes a fresh temp that is stored right
+ * after. Plain copies need no temp since they can load or store the
+ * slot directly. The temps live for one instruction, so they color on
+ * the next round.
+ */
+void CodeGenerator::insertSpillCode(int begin, vector<Location*> &spills)
+{
+    for (int i = 0; i < spills.size(); i++)
+    {
+        spills[i]->SetSpilled();
+        spills[i]->SetRegister(Mips::zero);
+        PrintDebug("regalloc", "%s: spilling %s", functionName(begin).c_str(),
+                   spills[i]->GetName());
+    }
+
+    vector<Instruction*> body;
+    for (int i = begin; i < code->NumElements(); i++)
+    {
+        Instruction* instruction = code->Nth(i);
+        if (dynamic_cast<Assign*>(instruction))
+        {
+            body.push_back(instruction);
+            continue;
+        }
+        List<Location*> genSet = instruction->GenSet();
+        List<Location*> killSet = instruction->KillSet();
+        genSet.Unique();
+        for (int j = 0; j < genSet.NumElements(); j++)
+        {
+            Location* home = genSet.Nth(j);
+            if (find(spills.begin(), spills.end(), home) == spills.end())
+                continue;
+            Location* temp = GenSpillTemp(home);
+            body.push_back(new Assign(temp, home));
+            instruction->RenameUse(home, temp);
+        }
+        body.push_back(instruction);
+        for (int j = 0; j < killSet.NumElements(); j++)
+        {
+            Location* home = killSet.Nth(j);
+            if (find(spills.begin(), spills.end(), home) == spills.end())
+                continue;
+            Location* temp = GenSpillTemp(home);
+            instruction->RenameDef(home, temp);
+            body.push_back(new Assign(home, temp));
+        }
+    }
+    replaceFunctionCode(begin, body);
 }
 
 char *CodeGenerator::NewLabel()
@@ -512,6 +1293,21 @@ Location *CodeGenerator::GenTempVar()
 }
 
   
+  // A register copy of a spilled location. It shares the location's
+  // stack slot, so if it doesn't get a register either it still
+  // reads and writes the right memory.
+Location *CodeGenerator::GenSpillTemp(Location *home)
+{
+  static int nextSpillNum;
+  char temp[64];
+  snprintf(temp, sizeof(temp), "%s.%d", home->GetName(), nextSpillNum++);
+  Location *result = new Location(home->GetSegment(), home->GetOffset(), temp);
+  spillTemps->insert(result);
+  return result;
+}
+
+  // The offset is provisional: it keeps each local's slot apart until
+  // assignStackSlots gives the ones that need memory their real place.
 Location *CodeGenerator::GenLocalVariable(const char *varName)
 {            
     curStackOffset -= VarSize;
@@ -529,6 +1325,7 @@ Location *CodeGenerator::GenLoadConstant(int value)
 {
   Location *result = GenTempVar();
   code->Append(new LoadConstant(result, value));
+  constants[result] = value;
   return result;
 }
 
@@ -566,11 +1363,39 @@ void CodeGenerator::GenStore(Location *dst,Location *src, int offset)
 }
 
 
+  // A constant operand becomes the immediate of the instruction when it
+  // fits one (swapping the operands if it's the first), and a multiply
+  // by a power of two becomes a shift. The LoadConstant is left for
+  // dead code elimination to take out.
 Location *CodeGenerator::GenBinaryOp(const char *opName, Location *op1,
 						     Location *op2)
 {
   Location *result = GenTempVar();
-  code->Append(new BinaryOp(BinaryOp::OpCodeForName(opName), result, op1, op2));
+  Mips::OpCode op = BinaryOp::OpCodeForName(opName);
+  if (constants.count(op1) && !constants.count(op2) && BinaryOp::Swapped(op) != Mips::NumOps)
+  {
+      Location *tmp = op1;
+      op1 = op2;
+      op2 = tmp;
+      op = BinaryOp::Swapped(op);
+  }
+  int value = constants.count(op2) ? constants[op2] : 0;
+  if (constants.count(op2) && op == Mips::Mul && value > 0 && !(value & (value - 1)))
+  {
+      op = Mips::Sll;
+      value = __builtin_ctz(value);
+  }
+  if (constants.count(op2) && Mips::HasImmediateForm(op, value))
+      code->Append(new BinaryOp(op, result, op1, value));
+  else
+      code->Append(new BinaryOp(op, result, op1, op2));
+  return result;
+}
+
+Location *CodeGenerator::GenUnaryOp(const char *opName, Location *op)
+{
+  Location *result = GenTempVar();
+  code->Append(new BinaryOp(BinaryOp::OpCodeForName(opName, true), result, op));
   return result;
 }
 
@@ -583,9 +1408,48 @@ void CodeGenerator::GenLabel(const char *label)
   (*labels)[s] = instruction;
 }
 
+  // A test that was computed by a comparison (or a not) right before is
+  // a temp nothing else reads, so the two are fused into one IfCompare
+  // that branches on the comparison (or its negation, for IfZ). Branches
+  // take any constant as their second operand.
+void CodeGenerator::genTestBranch(Location *test, bool whenTrue, const char *label)
+{
+  BinaryOp *cmp = dynamic_cast<BinaryOp*>(code->Nth(code->NumElements() - 1));
+  Mips::OpCode branch = Mips::NumOps;
+  if (cmp && cmp->GetDst() == test)
+  {
+      if (cmp->GetOpCode() == Mips::Not)
+          branch = whenTrue ? Mips::Eq : Mips::Ne;
+      else if (BinaryOp::Negated(cmp->GetOpCode()) != Mips::NumOps)
+          branch = whenTrue ? cmp->GetOpCode() : BinaryOp::Negated(cmp->GetOpCode());
+  }
+  if (branch == Mips::NumOps)
+  {
+      if (whenTrue)
+          code->Append(new IfCompare(Mips::Ne, test, 0, label));
+      else
+          code->Append(new IfZ(test, label));
+  }
+  else
+  {
+      code->RemoveAt(code->NumElements() - 1);
+      Location *op2 = cmp->GetOp2();
+      if (op2 && !constants.count(op2))
+          code->Append(new IfCompare(branch, cmp->GetOp1(), op2, label));
+      else
+          code->Append(new IfCompare(branch, cmp->GetOp1(),
+                                     op2 ? constants[op2] : cmp->GetImmediate(), label));
+  }
+}
+
 void CodeGenerator::GenIfZ(Location *test, const char *label)
 {
-  code->Append(new IfZ(test, label));
+  genTestBranch(test, false, label);
+}
+
+void CodeGenerator::GenIfNZ(Location *test, const char *label)
+{
+  genTestBranch(test, true, label);
 }
 
 void CodeGenerator::GenGoto(const char *label)
@@ -603,17 +1467,44 @@ BeginFunc *CodeGenerator::GenBeginFunc(FnDecl *fn)
 {
   BeginFunc *result = new BeginFunc();
   code->Append(insideFn = result);
+  curStackOffset = OffsetToFirstLocal;
+  maxOutgoing = 0;
+
+  // "this" is the hidden first parameter of a method
+  List<const char*> names;
+  if (fn->IsMethodDecl()) names.Append("this");
   List<VarDecl*> *formals = fn->GetFormals();
-  int start = OffsetToFirstParam;
-  if (fn->IsMethodDecl()) start += VarSize;
   for (int i = 0; i < formals->NumElements(); i++)
+    names.Append(formals->Nth(i)->GetName());
+
+  // The first NumArgRegs arrive in a0-a3 and are copied out to locals
+  // of their own (the copies usually coalesce away). The rest are on
+  // the stack where the caller put them, which stays their home; they
+  // are loaded from a second Location for the same slot, one that
+  // never gets a register (sinkParameterLoads may move the load down).
+  List<Location*> params;
+  for (int i = 0; i < names.NumElements(); i++)
   {
-    Location* param = new Location(fpRelative, i*VarSize + start, formals->Nth(i)->GetName());
-    formals->Nth(i)->rtLoc = param;
-    result->addParameter(param);
+    Location* param;
+    if (i < NumArgRegs)
+    {
+      param = GenLocalVariable(names.Nth(i));
+      GenAssign(param, argRegs.Nth(i));
+    }
+    else
+    {
+      int offset = OffsetToFirstParam + (i-NumArgRegs)*VarSize;
+      param = new Location(fpRelative, offset, names.Nth(i));
+      string incoming = string(names.Nth(i)) + ".in";
+      Location* slot = new Location(fpRelative, offset, incoming.c_str());
+      slot->SetSpilled();
+      GenAssign(param, slot);
+    }
+    params.Append(param);
   }
-  curStackOffset = OffsetToFirstLocal;
-  result->checkMethod(fn);
+  thisLoc = fn->IsMethodDecl() ? params.Nth(0) : NULL;
+  for (int i = 0; i < formals->NumElements(); i++)
+    formals->Nth(i)->rtLoc = params.Nth(i + fn->IsMethodDecl());
   return result;
 }
 
@@ -621,52 +1512,62 @@ void CodeGenerator::GenEndFunc()
 {
   code->Append(new EndFunc());
   insideFn->SetFrameSize(OffsetToFirstLocal-curStackOffset);
+  insideFn->SetOutgoingSize(maxOutgoing);
   insideFn = NULL;
 }
 
-void CodeGenerator::GenPushParam(Location *param)
+void CodeGenerator::GenPushParam(Location *param, int offset)
 {
-  code->Append(new PushParam(param));
+  code->Append(new PushParam(param, offset));
+  if (offset > maxOutgoing)
+    maxOutgoing = offset;
 }
 
-void CodeGenerator::GenPopParams(int numBytesOfParams)
+  // Moves the arguments of a call into place: those past the first
+  // NumArgRegs are stored into the outgoing-argument area (right to
+  // left, as they used to be pushed), then the first ones are copied
+  // into a0-a3.
+void CodeGenerator::GenArguments(List<Location*> *args)
 {
-  Assert(numBytesOfParams >= 0 && numBytesOfParams % VarSize == 0); // sanity check
-  if (numBytesOfParams > 0)
-    code->Append(new PopParams(numBytesOfParams));
+  for (int i = args->NumElements()-1; i >= NumArgRegs; i--)
+    GenPushParam(args->Nth(i), OffsetToFirstParam + (i-NumArgRegs)*VarSize);
+  for (int i = 0; i < args->NumElements() && i < NumArgRegs; i++)
+    GenAssign(argRegs.Nth(i), args->Nth(i));
 }
 
-Location *CodeGenerator::GenLCall(const char *label, bool fnHasReturnValue)
+Location *CodeGenerator::GenLCall(const char *label, bool fnHasReturnValue, int numArgRegs)
 {
   Location *result = fnHasReturnValue ? GenTempVar() : NULL;
-  code->Append(new LCall(label, result));
+  LCall *call = new LCall(label, result);
+  call->SetArgRegisters(&argRegs, numArgRegs);
+  code->Append(call);
   return result;
 }
   
 Location *CodeGenerator::GenFunctionCall(const char *fnLabel, List<Location*> *args, bool hasReturnValue)
 {
-  for (int i = args->NumElements()-1; i >= 0; i--) // push params right to left
-    GenPushParam(args->Nth(i));
-  Location *result = GenLCall(fnLabel, hasReturnValue);
-  GenPopParams(args->NumElements()*VarSize);
+  GenArguments(args);
+  Location *result = GenLCall(fnLabel, hasReturnValue, min(args->NumElements(), (int)NumArgRegs));
   return result;
 }
 
-Location *CodeGenerator::GenACall(Location *fnAddr, bool fnHasReturnValue)
+Location *CodeGenerator::GenACall(Location *fnAddr, bool fnHasReturnValue, int numArgRegs)
 {
   Location *result = fnHasReturnValue ? GenTempVar() : NULL;
-  code->Append(new ACall(fnAddr, result));
+  ACall *call = new ACall(fnAddr, result);
+  call->SetArgRegisters(&argRegs, numArgRegs);
+  code->Append(call);
   return result;
 }
   
 Location *CodeGenerator::GenMethodCall(Location *rcvr,
 			     Location *meth, List<Location*> *args, bool fnHasReturnValue)
 {
-  for (int i = args->NumElements()-1; i >= 0; i--)
-    GenPushParam(args->Nth(i));
-  GenPushParam(rcvr);	// hidden "this" parameter
-  Location *result= GenACall(meth, fnHasReturnValue);
-  GenPopParams((args->NumElements()+1)*VarSize);
+  List<Location*> all;
+  all.Append(rcvr);	// hidden "this" parameter
+  all.AppendAll(*args);
+  GenArguments(&all);
+  Location *result= GenACall(meth, fnHasReturnValue, min(all.NumElements(), (int)NumArgRegs));
   return result;
 }
  
@@ -685,6 +1586,12 @@ static struct _builtin {
   {"_PrintBool", 1, false},
   {"_Halt", 0, false}};
 
+const char *CodeGenerator::BuiltInLabel(BuiltIn bn)
+{
+  Assert(bn >= 0 && bn < NumBuiltIns);
+  return builtins[bn].label;
+}
+
 Location *CodeGenerator::GenBuiltInCall(BuiltIn bn,Location *arg1, Location *arg2)
 {
   Assert(bn >= 0 && bn < NumBuiltIns);
@@ -696,10 +1603,11 @@ Location *CodeGenerator::GenBuiltInCall(BuiltIn bn,Location *arg1, Location *arg
   Assert((b->numArgs == 0 && !arg1 && !arg2)
 	|| (b->numArgs == 1 && arg1 && !arg2)
 	|| (b->numArgs == 2 && arg1 && arg2));
-  if (arg2) code->Append(new PushParam(arg2));
-  if (arg1) code->Append(new PushParam(arg1));
-  code->Append(new LCall(b->label, result));
-  GenPopParams(VarSize*b->numArgs);
+  if (arg1) GenAssign(argRegs.Nth(0), arg1);
+  if (arg2) GenAssign(argRegs.Nth(1), arg2);
+  LCall *call = new LCall(b->label, result);
+  call->SetArgRegisters(&argRegs, b->numArgs);
+  code->Append(call);
   return result;
 }
 
@@ -753,13 +1661,11 @@ Location *CodeGenerator::GenDynamicDispatch(Location *rcvr, int vtableOffset, Li
 Location *CodeGenerator::GenSubscript(Location *array, Location *index)
 {
   Location *zero = GenLoadConstant(0);
-  Location *isNegative = GenBinaryOp("<", index, zero);
+  const char *error = NewLabel(), *pastError = NewLabel();
+  GenIfNZ(GenBinaryOp("<", index, zero), error);
   Location *count = GenLoad(array, -4);
-  Location *isWithinRange = GenBinaryOp("<", index, count);
-  Location *pastEnd = GenBinaryOp("==", isWithinRange, zero);
-  Location *outOfRange = GenBinaryOp("||", isNegative, pastEnd);
-  const char *pastError = NewLabel();
-  GenIfZ(outOfRange, pastError);
+  GenIfNZ(GenBinaryOp("<", index, count), pastError);
+  GenLabel(error);
   GenHaltWithMessage(err_arr_out_of_bounds);
   GenLabel(pastError);
   Location *four = GenLoadConstant(VarSize);
@@ -12,8 +12,12 @@
 #include <stdlib.h>
 #include "list.h"
 #include "tac.h"
+#include "dataflow.h"
+#include "interference.h"
 #include <string.h>
 #include <unordered_map>
+#include <unordered_set>
+#include <vector>
 class FnDecl;
  
 
@@ -25,43 +29,75 @@ typedef enum { Alloc, ReadLine, ReadInteger, StringEqual,
 class CodeGenerator {
   private:
     List<Instruction*> *code;
-    List<Location*>* interGraph;
+    InterferenceGraph* interGraph;  // current function's interference, by Location id
 
     int curStackOffset, curGlobalOffset;
+    int maxOutgoing;                // bytes of stack arguments of the biggest call so far
     BeginFunc *insideFn;
     unordered_map<string, Instruction*>* labels;
-    vector<Instruction*>* deletedCode;
-    
+    vector<Location*>* locations;   // current function's Locations, by id
+    FlowGraph* flowGraph;           // current function's basic blocks
+    unordered_set<Location*>* spillTemps;   // made by insertSpillCode
+    vector<int> alias;              // Location id -> id it was coalesced with
+    vector<unsigned int> callClobbers;  // Location id -> registers clobbered
+                                        // by the calls it lives across
+    vector<int> functionBegins;     // functions waiting for AllocateRegisters
+    List<Location*> argRegs;        // precolored a0-a3, shared by all functions
+    Location *thisLoc;              // current method's "this", NULL in functions
+    unordered_map<Location*, int> constants;    // temps made by GenLoadConstant
+
+    string functionName(int begin);
+    void replaceFunctionCode(int begin, vector<Instruction*> &body);
+    void rebuildFromBlocks(int begin);
+    void numberLocations(int begin);
     void livenessAnalysis(int begin);
-    bool deadCodeAnalysis(int begin);
+    void simplifyControlFlow(int begin);
+    void insertPreheaders(int begin);
+    void optimizeSSA(int begin);
+    void deadCodeElimination(int begin);
+    void sinkParameterLoads(int begin);
     void interferenceGraph(int begin);
-	int  findNode(List<Location*> removed); 
-	int  findMaxKNode(List<Location*> removed); 
-	bool wasRemoved(Location* check, List<Location*> removed); 
+    int aliasOf(int l);
+    void coalesceMoves(int begin);
+    void removeCoalescedMoves(int begin);
+    void assignStackSlots(int begin);
+    vector<double> spillCosts();
+    void insertSpillCode(int begin, vector<Location*> &spills);
+    Location *GenSpillTemp(Location *home);
+    void GenArguments(List<Location*> *args);
+    void genTestBranch(Location *test, bool whenTrue, const char *label);
 	
   public:
            // Here are some class constants to remind you of the offsets
            // used for globals, locals, and parameters. You will be
            // responsible for using these when assigning Locations.
            // In a MIPS stack frame, first local is at fp-8, subsequent locals
-           // are at fp-12, fp-16, and so on. The first param is at fp+4,
-           // subsequent ones as fp+8, fp+12, etc. (Because methods have secret
-           // "this" passed in first param slot at fp+4, all normal params
-           // are shifted up by 4.)  First global is at offset 0 from global
-           // pointer, all subsequent at +4, +8, etc.
+           // are at fp-12, fp-16, and so on. The first NumArgRegs params
+           // are passed in a0-a3 (methods have secret "this" as the first
+           // one, so all normal params are shifted along by one), the fifth
+           // is at fp+4, subsequent ones at fp+8, fp+12, etc. First global
+           // is at offset 0 from global pointer, all subsequent at +4, +8, etc.
            // Conveniently, all vars are 4 bytes in size for code generation
     static const int OffsetToFirstLocal = -8,
                      OffsetToFirstParam = 4,
                      OffsetToFirstGlobal = 0;
     static const int VarSize = 4;
+    static const int NumArgRegs = 4;
 
     CodeGenerator();
     
-    //Create CFG for use in liveness analysis
-    void createCFG(int begin);
+    // Records the function whose BeginFunc is at begin, once all of
+    // its code has been generated
+    void AddFunction(int begin);
+
+    // Allocates registers for all the functions added, callees first
+    void AllocateRegisters();
+
+    //Create CFG of basic blocks, then run liveness and allocate registers
+    unsigned int createCFG(int begin);
     
-    //Get Kcoloring
-    void kColoring();
+    //Get Kcoloring, the locations that couldn't be colored go in spills
+    void kColoring(vector<Location*> &spills);
 
     
     int numInstructions() { return code->NumElements(); }
@@ -116,32 +152,32 @@ class CodeGenerator {
          // was stored.
     Location *GenBinaryOp(const char *opName, Location *op1, Location *op2);
 
-    
-         // Generates the Tac instruction for pushing a single
-         // parameter. Used to set up for ACall and LCall instructions.
-         // The Decaf convention is that parameters are pushed right
-         // to left (so the first argument is pushed last)
-    void GenPushParam(Location *param);
+         // Same for the unary ops "-" and "!"
+    Location *GenUnaryOp(const char *opName, Location *op);
 
-         // Generates the Tac instruction for popping parameters to
-         // clean up after an ACall or LCall instruction. All parameters
-         // are removed with one adjustment of the stack pointer.
-    void GenPopParams(int numBytesOfParams);
+    
+         // Generates the Tac instruction for passing a single
+         // parameter on the stack. Used to set up for ACall and LCall
+         // instructions. The parameter is stored offset bytes above $sp,
+         // in the outgoing-argument area the function reserves once for
+         // all its calls, so nothing needs popping after the call.
+    void GenPushParam(Location *param, int offset);
 
          // Generates the Tac instructions for a LCall, a jump to
          // a compile-time label. The params to the target routine
-         // should already have been pushed. If hasReturnValue is
+         // should already have been pushed, or copied into the first
+         // numArgRegs argument registers. If hasReturnValue is
          // true,  a new temp var is created, the fn result is stored 
          // there and that Location is returned. If false, no temp is
          // created and NULL is returned
-    Location *GenLCall(const char *label, bool fnHasReturnValue);
+    Location *GenLCall(const char *label, bool fnHasReturnValue, int numArgRegs = 0);
 
          // Generates the Tac instructions for ACall, a jump to an
          // address computed at runtime. Works similarly to LCall,
          // described above, in terms of return type.
          // The fnAddr Location is expected to hold the address of
          // the code to jump to (typically it was read from the vtable)
-    Location *GenACall(Location *fnAddr, bool fnHasReturnValue);
+    Location *GenACall(Location *fnAddr, bool fnHasReturnValue, int numArgRegs = 0);
 
          // Generates the Tac instructions to call one of
          // the built-in functions (Read, Print, Alloc, etc.) Although
@@ -153,6 +189,7 @@ class CodeGenerator {
          // built-ins with no return value (Print/Halt), no temporary
          // is created and NULL is returned.
     Location *GenBuiltInCall(BuiltIn b, Location *arg1 = NULL, Location *arg2 = NULL);
+    static const char *BuiltInLabel(BuiltIn b);
 
     
          // These methods generate the Tac instructions for various
@@ -161,6 +198,7 @@ class CodeGenerator {
          // (or omit arg) to GenReturn for a return that does not
          // return a value
     void GenIfZ(Location *test, const char *label);
+    void GenIfNZ(Location *test, const char *label);
     void GenGoto(const char *label);
     void GenReturn(Location *val = NULL);
     void GenLabel(const char *label);
@@ -169,6 +207,8 @@ class CodeGenerator {
          // These methods generate the Tac instructions that mark the start
          // and end of a function/method definition. 
     BeginFunc *GenBeginFunc(FnDecl *fn);
+         // The Location of "this" in the method being generated
+    Location *GetThis()                   { return thisLoc; }
     void GenEndFunc();
 
     
@@ -0,0 +1,433 @@
+/* File: dataflow.cc
+ * -----------------
+ * Implementation of the basic-block flow graph and the worklist
+ * dataflow solver.
+ */
+
+#include "dataflow.h"
+#include "tac.h"
+#include <queue>
+#include <functional>
+
+using namespace std;
+
+FlowGraph::FlowGraph(List<Instruction*> *code, int begin,
+                     unordered_map<string, Instruction*> *labels)
+{
+    Assert(dynamic_cast<BeginFunc*>(code->Nth(begin)));
+    BasicBlock *cur = NULL;
+    bool startNew = true;
+    int end;
+    for (end = begin; end < code->NumElements(); end++)
+    {
+        Instruction* instruction = code->Nth(end);
+        if (startNew || dynamic_cast<Label*>(instruction))
+        {
+            cur = new BasicBlock(blocks.NumElements());
+            blocks.Append(cur);
+        }
+        cur->code.Append(instruction);
+        blockOf[instruction] = cur;
+        startNew = dynamic_cast<Goto*>(instruction) || dynamic_cast<CondBranch*>(instruction)
+                || dynamic_cast<Return*>(instruction);
+        if (dynamic_cast<EndFunc*>(instruction))
+            break;
+    }
+
+    for (int i = 0; i < blocks.NumElements(); i++)
+    {
+        BasicBlock *b = blocks.Nth(i);
+        Instruction *last = b->code.Nth(b->code.NumElements() - 1);
+        BasicBlock *next = i + 1 < blocks.NumElements() ? blocks.Nth(i + 1) : NULL;
+        Goto *gt = dynamic_cast<Goto*>(last);
+        CondBranch *iz = dynamic_cast<CondBranch*>(last);
+        if (gt)
+            AddEdge(b, blockOf[(*labels)[gt->getLabel()]]);
+        else if (iz)
+        {
+            AddEdge(b, blockOf[(*labels)[iz->getLabel()]]);
+            if (next) AddEdge(b, next);
+        }
+        else if (!dynamic_cast<Return*>(last) && !dynamic_cast<EndFunc*>(last) && next)
+            AddEdge(b, next);
+    }
+    ComputeOrder();
+    ComputeDominators();
+    ComputeFrontiers();
+    ComputeLoops();
+}
+
+FlowGraph::~FlowGraph()
+{
+    for (int i = 0; i < blocks.NumElements(); i++)
+        delete blocks.Nth(i);
+    for (int i = 0; i < loops.NumElements(); i++)
+        delete loops.Nth(i);
+}
+
+void FlowGraph::AddEdge(BasicBlock *from, BasicBlock *to)
+{
+    Assert(from && to);
+    for (int i = 0; i < from->succs.NumElements(); i++)
+        if (from->succs.Nth(i) == to)
+            return;
+    from->succs.Append(to);
+    to->preds.Append(from);
+}
+
+/* Method: ComputeOrder
+ * --------------------
+ * Iterative depth-first search from the entry block recording the
+ * reverse postorder. Blocks that can't be reached from the entry are
+ * still in the function's code, so they go at the end of the order.
+ */
+void FlowGraph::ComputeOrder()
+{
+    vector<bool> visited(blocks.NumElements(), false);
+    vector<BasicBlock*> postorder;
+    vector<pair<BasicBlock*, int> > stack;
+    stack.push_back(make_pair(Entry(), 0));
+    visited[Entry()->id] = true;
+    while (!stack.empty())
+    {
+        BasicBlock *b = stack.back().first;
+        int next = stack.back().second++;
+        if (next < b->succs.NumElements())
+        {
+            BasicBlock *s = b->succs.Nth(next);
+            if (!visited[s->id])
+            {
+                visited[s->id] = true;
+                stack.push_back(make_pair(s, 0));
+            }
+        }
+        else
+        {
+            postorder.push_back(b);
+            stack.pop_back();
+        }
+    }
+    order.Clear();
+    numReachable = postorder.size();
+    for (int i = postorder.size() - 1; i >= 0; i--)
+        order.Append(postorder[i]);
+    for (int i = 0; i < blocks.NumElements(); i++)
+        if (!visited[i])
+            order.Append(blocks.Nth(i));
+}
+
+/* Method: ComputeDominators
+ * -------------------------
+ * Immediate dominators by the iterative algorithm of Cooper, Harvey and
+ * Kennedy: walk the reachable blocks in reverse postorder, intersecting
+ * the dominator chains of the already-processed predecessors, until
+ * nothing changes. Chains are compared by reverse postorder position.
+ */
+void FlowGraph::ComputeDominators()
+{
+    vector<int> position(blocks.NumElements(), -1);
+    for (int i = 0; i < numReachable; i++)
+        position[order.Nth(i)->id] = i;
+
+    vector<BasicBlock*> idom(blocks.NumElements(), (BasicBlock*)NULL);
+    idom[Entry()->id] = Entry();
+    bool changed = true;
+    while (changed)
+    {
+        changed = false;
+        for (int i = 1; i < numReachable; i++)
+        {
+            BasicBlock *b = order.Nth(i);
+            BasicBlock *newIdom = NULL;
+            for (int j = 0; j < b->preds.NumElements(); j++)
+            {
+                BasicBlock *p = b->preds.Nth(j);
+                if (!idom[p->id])
+                    continue;
+                if (!newIdom)
+                {
+                    newIdom = p;
+                    continue;
+                }
+                BasicBlock *x = p, *y = newIdom;
+                while (x != y)
+                {
+                    while (position[x->id] > position[y->id]) x = idom[x->id];
+                    while (position[y->id] > position[x->id]) y = idom[y->id];
+                }
+                newIdom = x;
+            }
+            if (idom[b->id] != newIdom)
+            {
+                idom[b->id] = newIdom;
+                changed = true;
+            }
+        }
+    }
+    for (int i = 0; i < blocks.NumElements(); i++)
+    {
+        BasicBlock *b = blocks.Nth(i);
+        b->idom = (i == Entry()->id) ? NULL : idom[i];
+        if (b->idom)
+            b->idom->children.Append(b);
+    }
+}
+
+/* Method: ComputeFrontiers
+ * ------------------------
+ * Dominance frontiers, again after Cooper, Harvey and Kennedy: a join
+ * point j is in the frontier of each block on the dominator chain from
+ * each of its predecessors up to (not including) idom(j).
+ */
+void FlowGraph::ComputeFrontiers()
+{
+    for (int i = 0; i < numReachable; i++)
+    {
+        BasicBlock *j = order.Nth(i);
+        if (j->preds.NumElements() < 2)
+            continue;
+        for (int k = 0; k < j->preds.NumElements(); k++)
+        {
+            BasicBlock *runner = j->preds.Nth(k);
+            if (!IsReachable(runner))
+                continue;
+            while (runner && runner != j->idom)
+            {
+                bool present = false;
+                for (int f = 0; f < runner->frontier.NumElements(); f++)
+                    present |= runner->frontier.Nth(f) == j;
+                if (!present)
+                    runner->frontier.Append(j);
+                runner = runner->idom;
+            }
+        }
+    }
+}
+
+bool FlowGraph::Dominates(BasicBlock *a, BasicBlock *b)
+{
+    if (!IsReachable(b))
+        return false;
+    for (; b; b = b->idom)
+        if (b == a)
+            return true;
+    return false;
+}
+
+/* Method: ComputeLoops
+ * --------------------
+ * Finds the natural loops: an edge b->h where h dominates b is a back
+ * edge, and the loop body is everything that reaches b backwards
+ * without passing h. Each block's loopDepth counts the loops it is in.
+ */
+void FlowGraph::ComputeLoops()
+{
+    for (int i = 0; i < numReachable; i++)
+    {
+        BasicBlock *h = order.Nth(i);
+        Loop *loop = NULL;
+        vector<BasicBlock*> stack;
+        for (int j = 0; j < h->preds.NumElements(); j++)
+        {
+            BasicBlock *b = h->preds.Nth(j);
+            if (!Dominates(h, b))
+                continue;
+            if (!loop)
+            {
+                loop = new Loop(h, blocks.NumElements());
+                loop->body.Append(h);
+                loop->contains.Set(h->id);
+            }
+            stack.push_back(b);
+        }
+        while (!stack.empty())
+        {
+            BasicBlock *b = stack.back();
+            stack.pop_back();
+            if (loop->contains.Test(b->id) || !IsReachable(b))
+                continue;
+            loop->body.Append(b);
+            loop->contains.Set(b->id);
+            for (int j = 0; j < b->preds.NumElements(); j++)
+                stack.push_back(b->preds.Nth(j));
+        }
+        if (loop)
+        {
+            loops.Append(loop);
+            for (int j = 0; j < loop->body.NumElements(); j++)
+                loop->body.Nth(j)->loopDepth++;
+        }
+    }
+}
+
+BasicBlock *FlowGraph::BlockFor(Instruction *instr)
+{
+    unordered_map<Instruction*, BasicBlock*>::iterator it = blockOf.find(instr);
+    return it == blockOf.end() ? NULL : it->second;
+}
+
+void FlowGraph::Compact()
+{
+    for (int i = 0; i < blocks.NumElements(); i++)
+    {
+        BasicBlock *b = blocks.Nth(i);
+        List<Instruction*> kept;
+        for (int j = 0; j < b->code.NumElements(); j++)
+        {
+            Instruction *instr = b->code.Nth(j);
+            if (instr->removed)
+                blockOf.erase(instr);
+            else
+                kept.Append(instr);
+        }
+        b->code = kept;
+    }
+}
+
+
+/* Method: Solve
+ * -------------
+ * Worklist iteration to the fixpoint. The worklist is a heap keyed on
+ * each block's position in the visiting order, so it drains in (reverse)
+ * postorder and a block is only revisited after something it depends on
+ * changed.
+ */
+void DataflowProblem::Solve(FlowGraph *graph)
+{
+    int n = graph->NumBlocks();
+    bool backward = (direction == Backward);
+    List<BasicBlock*> *rpo = graph->ReversePostorder();
+    vector<BasicBlock*> order;
+    for (int i = 0; i < rpo->NumElements(); i++)
+        order.push_back(rpo->Nth(backward ? rpo->NumElements() - 1 - i : i));
+
+    in.assign(n, BitVector(numBits));
+    out.assign(n, BitVector(numBits));
+    gen.assign(n, BitVector(numBits));
+    kill.assign(n, BitVector(numBits));
+    vector<int> position(n);
+    for (int i = 0; i < n; i++)
+    {
+        BasicBlock *b = order[i];
+        position[b->id] = i;
+        ComputeLocalSets(b, gen[b->id], kill[b->id]);
+        if (meet == Intersection)
+        {
+            in[b->id].SetAll();
+            out[b->id].SetAll();
+        }
+    }
+
+    iterations = 0;
+    bitsProcessed = 0;
+    priority_queue<int, vector<int>, greater<int> > worklist;
+    vector<bool> queued(n, true);
+    for (int i = 0; i < n; i++)
+        worklist.push(i);
+
+    while (!worklist.empty())
+    {
+        BasicBlock *b = order[worklist.top()];
+        worklist.pop();
+        queued[b->id] = false;
+        iterations++;
+
+        List<BasicBlock*> &sources = backward ? b->succs : b->preds;
+        List<BasicBlock*> &dependents = backward ? b->preds : b->succs;
+        BitVector &meetResult = backward ? out[b->id] : in[b->id];
+        BitVector &result = backward ? in[b->id] : out[b->id];
+
+        if (sources.NumElements() == 0)
+            Boundary(meetResult);
+        else
+        {
+            meetResult = backward ? in[sources.Nth(0)->id] : out[sources.Nth(0)->id];
+            for (int i = 1; i < sources.NumElements(); i++)
+            {
+                BitVector &s = backward ? in[sources.Nth(i)->id] : out[sources.Nth(i)->id];
+                if (meet == Union)
+                    meetResult.UnionWith(s);
+                else
+                    meetResult.IntersectWith(s);
+            }
+        }
+        bitsProcessed += (long)numBits * (sources.NumElements() + 1);
+
+        if (result.Transfer(meetResult, gen[b->id], kill[b->id]))
+        {
+            for (int i = 0; i < dependents.NumElements(); i++)
+            {
+                BasicBlock *d = dependents.Nth(i);
+                if (!queued[d->id])
+                {
+                    queued[d->id] = true;
+                    worklist.push(position[d->id]);
+                }
+            }
+        }
+    }
+}
+
+
+void LivenessProblem::ComputeLocalSets(BasicBlock *b, BitVector &use, BitVector &def)
+{
+    for (int i = b->code.NumElements() - 1; i >= 0; i--)
+    {
+        Instruction *instruction = b->code.Nth(i);
+        use.Transfer(use, instruction->gen, instruction->kill);
+        def.UnionWith(instruction->kill);
+    }
+}
+
+
+ReachingDefsProblem::ReachingDefsProblem(FlowGraph *graph, int numLocations)
+  : DataflowProblem(Forward, Union, 0)
+{
+    for (int b = 0; b < graph->NumBlocks(); b++)
+    {
+        BasicBlock *block = graph->Nth(b);
+        for (int i = 0; i < block->code.NumElements(); i++)
+        {
+            Instruction *instruction = block->code.Nth(i);
+            if (!instruction->kill.IsEmpty())
+            {
+                defIndex[instruction] = defs.size();
+                defs.push_back(instruction);
+            }
+        }
+    }
+    numBits = defs.size();
+    defsOf.assign(numLocations, BitVector(numBits));
+    for (int d = 0; d < defs.size(); d++)
+        for (int l = defs[d]->kill.NextSet(0); l != -1; l = defs[d]->kill.NextSet(l+1))
+            defsOf[l].Set(d);
+}
+
+int ReachingDefsProblem::DefId(Instruction *instr)
+{
+    unordered_map<Instruction*, int>::iterator it = defIndex.find(instr);
+    return it == defIndex.end() ? -1 : it->second;
+}
+
+void ReachingDefsProblem::Step(Instruction *instr, BitVector &reaching)
+{
+    int d = DefId(instr);
+    if (d == -1)
+        return;
+    for (int l = instr->kill.NextSet(0); l != -1; l = instr->kill.NextSet(l+1))
+        reaching.Subtract(defsOf[l]);
+    reaching.Set(d);
+}
+
+void ReachingDefsProblem::ComputeLocalSets(BasicBlock *b, BitVector &gen, BitVector &kill)
+{
+    for (int i = 0; i < b->code.NumElements(); i++)
+    {
+        Instruction *instruction = b->code.Nth(i);
+        if (DefId(instruction) == -1)
+            continue;
+        for (int l = instruction->kill.NextSet(0); l != -1; l = instruction->kill.NextSet(l+1))
+            kill.UnionWith(defsOf[l]);
+        Step(instruction, gen);
+    }
+}
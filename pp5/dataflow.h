@@ -0,0 +1,158 @@
+/* File: dataflow.h
+ * ----------------
+ * The FlowGraph class splits the Tac of one function into basic blocks
+ * and links them into a control-flow graph. The DataflowProblem class
+ * is a small framework for the classic bit-vector analyses over that
+ * graph: a subclass describes the direction, the meet operator and how
+ * to summarize one block as a gen/kill pair, and Solve() runs a
+ * worklist to the fixpoint.
+ *
+ * Blocks are visited in reverse postorder (postorder for backward
+ * problems) and a block is only put back on the worklist when one of
+ * the blocks feeding it changed.
+ */
+
+#ifndef _H_dataflow
+#define _H_dataflow
+
+#include "list.h"
+#include "bitvector.h"
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+class Instruction;
+
+class BasicBlock {
+  public:
+    int id;                     // index into the FlowGraph's blocks
+    List<Instruction*> code;    // the instructions, in order
+    List<BasicBlock*> succs, preds;
+    BasicBlock *idom;           // immediate dominator, NULL for the entry
+                                // and for unreachable blocks
+    List<BasicBlock*> children; // the blocks it immediately dominates
+    List<BasicBlock*> frontier; // dominance frontier: the first blocks it
+                                // doesn't strictly dominate on paths out
+    int loopDepth;              // number of natural loops containing it
+
+    BasicBlock(int n) : id(n), idom(NULL), loopDepth(0) {}
+};
+
+  // A natural loop: the header plus every block that can reach one of
+  // its back edges without going through the header. Back edges to the
+  // same header are merged into one loop.
+class Loop {
+  public:
+    BasicBlock *header;
+    List<BasicBlock*> body;     // includes the header
+    BitVector contains;         // by block id
+
+    Loop(BasicBlock *h, int numBlocks) : header(h), contains(numBlocks) {}
+};
+
+class FlowGraph {
+  private:
+    List<BasicBlock*> blocks;
+    List<BasicBlock*> order;    // reverse postorder, unreachable blocks last
+    int numReachable;           // length of the reachable prefix of order
+    List<Loop*> loops;
+    std::unordered_map<Instruction*, BasicBlock*> blockOf;
+
+    void AddEdge(BasicBlock *from, BasicBlock *to);
+    void ComputeOrder();
+    void ComputeDominators();
+    void ComputeFrontiers();
+    void ComputeLoops();
+
+  public:
+         // Builds the graph for the function whose BeginFunc is at
+         // index begin of code. A new block starts at each Label and
+         // after each Goto, conditional branch and Return.
+    FlowGraph(List<Instruction*> *code, int begin,
+              std::unordered_map<std::string, Instruction*> *labels);
+    ~FlowGraph();
+
+    int NumBlocks()                     { return blocks.NumElements(); }
+    BasicBlock *Nth(int i)              { return blocks.Nth(i); }
+    BasicBlock *Entry()                 { return blocks.Nth(0); }
+    BasicBlock *BlockFor(Instruction *instr);
+    List<BasicBlock*> *ReversePostorder() { return &order; }
+    bool IsReachable(BasicBlock *b)     { return b == Entry() || b->idom != NULL; }
+
+         // True if every path from the entry to b goes through a
+         // (a block dominates itself)
+    bool Dominates(BasicBlock *a, BasicBlock *b);
+    List<Loop*> *Loops()                { return &loops; }
+
+         // Drops every instruction flagged as removed from its block
+    void Compact();
+};
+
+
+class DataflowProblem {
+  public:
+    typedef enum { Forward, Backward } Direction;
+    typedef enum { Union, Intersection } MeetOp;
+
+  protected:
+    Direction direction;
+    MeetOp meet;
+    int numBits;
+
+  public:
+         // Per-block sets, indexed by BasicBlock id. For a backward
+         // problem "in" is at the top of the block and "out" at the
+         // bottom, same as for a forward one.
+    std::vector<BitVector> in, out, gen, kill;
+
+    int iterations;             // blocks visited by the last Solve
+    long bitsProcessed;         // bits touched by meets and transfers
+
+    DataflowProblem(Direction d, MeetOp m, int bits)
+      : direction(d), meet(m), numBits(bits), iterations(0), bitsProcessed(0) {}
+    virtual ~DataflowProblem() {}
+
+         // Summarizes block b: the transfer function of the whole block
+         // is result = gen | (x & ~kill). Both sets arrive empty.
+    virtual void ComputeLocalSets(BasicBlock *b, BitVector &gen, BitVector &kill) = 0;
+
+         // Value flowing into the entry (forward) or out of the exits
+         // (backward). Empty unless overridden.
+    virtual void Boundary(BitVector &v) { v.ClearAll(); }
+
+    void Solve(FlowGraph *graph);
+};
+
+
+  // Live variables: a Location is live if some path from here reaches
+  // a use before a redefinition. Uses the gen/kill bit vectors that
+  // CodeGenerator::numberLocations attaches to each Instruction.
+class LivenessProblem : public DataflowProblem {
+  public:
+    LivenessProblem(int numLocations) : DataflowProblem(Backward, Union, numLocations) {}
+    void ComputeLocalSets(BasicBlock *b, BitVector &use, BitVector &def);
+};
+
+
+  // Reaching definitions: which defining instructions may have written
+  // the current value of each Location. Every instruction that defines
+  // a numbered Location gets a def id; defsOf groups them by Location.
+class ReachingDefsProblem : public DataflowProblem {
+  private:
+    std::unordered_map<Instruction*, int> defIndex;
+
+  public:
+    std::vector<Instruction*> defs;     // def id -> instruction
+    std::vector<BitVector> defsOf;      // Location id -> its def ids
+
+    ReachingDefsProblem(FlowGraph *graph, int numLocations);
+    void ComputeLocalSets(BasicBlock *b, BitVector &gen, BitVector &kill);
+
+         // Def id of instr, or -1 if it defines no numbered Location
+    int DefId(Instruction *instr);
+
+         // Advances a reaching set over one instruction
+    void Step(Instruction *instr, BitVector &reaching);
+};
+
+#endif
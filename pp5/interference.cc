@@ -0,0 +1,61 @@
+/* File: interference.cc
+ * ---------------------
+ * Implementation of the InterferenceGraph class.
+ */
+
+#include "interference.h"
+
+InterferenceGraph::InterferenceGraph(int n)
+  : numEdges(0), matrix(n * (n - 1) / 2), present(n), adjacent(n)
+{
+}
+
+void InterferenceGraph::AddNode(int n)
+{
+    if (present.Test(n))
+        return;
+    present.Set(n);
+    nodes.push_back(n);
+}
+
+bool InterferenceGraph::AddEdge(int a, int b)
+{
+    AddNode(a);
+    AddNode(b);
+    if (a == b || matrix.Test(Index(a, b)))
+        return false;
+    matrix.Set(Index(a, b));
+    adjacent[a].push_back(b);
+    adjacent[b].push_back(a);
+    numEdges++;
+    return true;
+}
+
+void InterferenceGraph::Merge(int keep, int gone)
+{
+    Assert(keep != gone && HasNode(keep) && HasNode(gone) && !Interferes(keep, gone));
+    std::vector<int> edges = adjacent[gone];
+    for (int i = 0; i < edges.size(); i++)
+    {
+        int n = edges[i];
+        std::vector<int> &adj = adjacent[n];
+        for (int j = 0; j < adj.size(); j++)
+            if (adj[j] == gone)
+            {
+                adj[j] = adj.back();
+                adj.pop_back();
+                break;
+            }
+        matrix.Reset(Index(n, gone));
+        numEdges--;
+        AddEdge(keep, n);
+    }
+    adjacent[gone].clear();
+    present.Reset(gone);
+    for (int i = 0; i < nodes.size(); i++)
+        if (nodes[i] == gone)
+        {
+            nodes.erase(nodes.begin() + i);
+            break;
+        }
+}
@@ -0,0 +1,57 @@
+/* File: interference.h
+ * --------------------
+ * The InterferenceGraph class records which Locations of a function are
+ * live at the same time and so can't share a register. Nodes are the
+ * dense Location ids handed out by CodeGenerator::numberLocations.
+ *
+ * Edges are kept twice: a triangular bit matrix answers "do a and b
+ * interfere?" in constant time (and makes adding an edge that is already
+ * there free), and a vector of neighbours per node is what the allocator
+ * walks. Degrees are counted as edges go in.
+ */
+
+#ifndef _H_interference
+#define _H_interference
+
+#include "bitvector.h"
+#include <vector>
+
+class InterferenceGraph {
+
+  private:
+    int numEdges;
+    BitVector matrix;                       // bit (a,b) for a > b
+    BitVector present;                      // nodes taking part in allocation
+    std::vector<int> nodes;                 // members of present, in order added
+    std::vector<std::vector<int> > adjacent;
+
+    static int Index(int a, int b)
+        { if (a < b) { int t = a; a = b; b = t; }
+          return a * (a - 1) / 2 + b; }
+
+  public:
+           // Create a graph over nodes 0..n-1 with no nodes or edges yet
+    InterferenceGraph(int n);
+
+    int NumEdges() const                    { return numEdges; }
+
+           // Puts node n in the graph, it's a no-op if n is already there
+    void AddNode(int n);
+    bool HasNode(int n) const               { return present.Test(n); }
+    const std::vector<int> &Nodes() const   { return nodes; }
+
+           // Adds the edge a-b (and both nodes). Self edges are ignored.
+           // Returns true if the edge is new.
+    bool AddEdge(int a, int b);
+    bool Interferes(int a, int b) const
+        { return a != b && matrix.Test(Index(a, b)); }
+
+           // Folds node gone into node keep (coalescing): keep takes
+           // over all of gone's edges and gone leaves the graph
+    void Merge(int keep, int gone);
+
+    int Degree(int n) const                 { return adjacent[n].size(); }
+    const std::vector<int> &Neighbors(int n) const { return adjacent[n]; }
+};
+
+#endif
@@ -37,42 +37,20 @@ int main(int argc, char *argv[])
 void SysCallCodeGen()
 {
     printf("  _PrintInt:\n");
-    printf("	  subu $sp, $sp, 8	# decrement sp to make space to save ra,fp\n");
-    printf("	  sw $fp, 8($sp)	# save fp\n");
-    printf("	  sw $ra, 4($sp)	# save ra\n");
-    printf("	  addiu $fp, $sp, 8	# set up new fp\n");
-    printf("	  lw $a0, 4($fp)	# fill a from $fp+4\n");
     printf("	# LCall _PrintInt\n");
     printf("	  li $v0, 1\n");
     printf("	  syscall\n");
     printf("	# EndFunc\n");
-    printf("	# (below handles reaching end of fn body with no explicit return)\n");
-    printf("	  move $sp, $fp		# pop callee frame off stack\n");
-    printf("	  lw $ra, -4($fp)	# restore saved ra\n");
-    printf("	  lw $fp, 0($fp)	# restore saved fp\n");
     printf("	  jr $ra		# return from function\n");
     printf("\n");
     printf("  _ReadInteger:\n");
-    printf("	  subu $sp, $sp, 8	# decrement sp to make space to save ra,fp\n");
-    printf("	  sw $fp, 8($sp)	# save fp\n");
-    printf("	  sw $ra, 4($sp)	# save ra\n");
-    printf("	  addiu $fp, $sp, 8	# set up new fp\n");
     printf("	  li $v0, 5\n");
     printf("	  syscall\n");
     printf("	# EndFunc\n");
-    printf("	# (below handles reaching end of fn body with no explicit return)\n");
-    printf("	  move $sp, $fp		# pop callee frame off stack\n");
-    printf("	  lw $ra, -4($fp)	# restore saved ra\n");
-    printf("	  lw $fp, 0($fp)	# restore saved fp\n");
     printf("	  jr $ra		# return from function\n");
     printf("\n");
     printf("\n");
     printf("  _PrintBool:\n");
-    printf("	  subu $sp, $sp, 8      # decrement sp to make space to save ra, fp\n");
-    printf("	  sw $fp, 8($sp)        # save fp\n");
-    printf("	  sw $ra, 4($sp)        # save ra\n");
-    printf("	  addiu $fp, $sp, 8     # set up new fp\n");
-    printf("	  lw $a0, 4($fp)        # fill a from $fp+4\n");
     printf("	  li $v0, 4\n");
     printf("	  beq $a0, $0, PrintBoolFalse\n");
     printf("	  la $a0, _PrintBoolTrueString\n");
@@ -82,10 +60,6 @@ void SysCallCodeGen()
     printf("  PrintBoolEnd:\n");
     printf("	  syscall\n");
     printf("	# EndFunc\n");
-    printf("	# (below handles reaching end of fn body with no explicit return)\n");
-    printf("	  move $sp, $fp         # pop callee frame off stack\n");
-    printf("	  lw $ra, -4($fp)       # restore saved ra\n");
-    printf("	  lw $fp, 0($fp)        # restore saved fp\n");
     printf("	  jr $ra                # return from function\n");
     printf("\n");
     printf("      .data			# create string constant marked with label\n");
@@ -97,33 +71,15 @@ void SysCallCodeGen()
     printf("      .text\n");
     printf("\n");
     printf("  _PrintString:\n");
-    printf("	  subu $sp, $sp, 8      # decrement sp to make space to save ra, fp\n");
-    printf("	  sw $fp, 8($sp)        # save fp\n");
-    printf("	  sw $ra, 4($sp)        # save ra\n");
-    printf("	  addiu $fp, $sp, 8     # set up new fp\n");
-    printf("	  lw $a0, 4($fp)        # fill a from $fp+4\n");
     printf("	  li $v0, 4\n");
     printf("	  syscall\n");
     printf("	# EndFunc\n");
-    printf("	# (below handles reaching end of fn body with no explicit return)\n");
-    printf("	  move $sp, $fp         # pop callee frame off stack\n");
-    printf("	  lw $ra, -4($fp)       # restore saved ra\n");
-    printf("	  lw $fp, 0($fp)        # restore saved fp\n");
     printf("	  jr $ra                # return from function\n");
     printf("\n");
     printf("  _Alloc:\n");
-    printf("	  subu $sp, $sp, 8      # decrement sp to make space to save ra,fp\n");
-    printf("	  sw $fp, 8($sp)        # save fp\n");
-    printf("	  sw $ra, 4($sp)        # save ra\n");
-    printf("	  addiu $fp, $sp, 8     # set up new fp\n");
-    printf("	  lw $a0, 4($fp)        # fill a from $fp+4\n");
     printf("	  li $v0, 9\n");
     printf("	  syscall\n");
     printf("	# EndFunc\n");
-    printf("	# (below handles reaching end of fn body with no explicit return)\n");
-    printf("	  move $sp, $fp         # pop callee frame off stack\n");
-    printf("	  lw $ra, -4($fp)       # restore saved ra\n");
-    printf("	  lw $fp, 0($fp)        # restore saved fp\n");
     printf("	  jr $ra                # return from function\n");
     printf("\n");
     printf("  _Halt:\n");
@@ -133,12 +89,6 @@ void SysCallCodeGen()
     printf("\n");
     printf("\n");
     printf("  _StringEqual:\n");
-    printf("	  subu $sp, $sp, 8      # decrement sp to make space to save ra, fp\n");
-    printf("	  sw $fp, 8($sp)        # save fp\n");
-    printf("	  sw $ra, 4($sp)        # save ra\n");
-    printf("	  addiu $fp, $sp, 8     # set up new fp\n");
-    printf("	  lw $a0, 4($fp)        # fill a from $fp+4\n");
-    printf("	  lw $a1, 8($fp)        # fill a from $fp+8\n");
     printf("	  beq $a0,$a1,Lrunt10\n");
     printf("  Lrunt12:\n");
     printf("	  lbu  $v0,($a0)\n");
@@ -153,19 +103,11 @@ void SysCallCodeGen()
     printf("	  li  $v0,0\n");
     printf("  Lrunt10:\n");
     printf("	# EndFunc\n");
-    printf("	# (below handles reaching end of fn body with no explicit return)\n");
-    printf("	  move $sp, $fp         # pop callee frame off stack\n");
-    printf("	  lw $ra, -4($fp)       # restore saved ra\n");
-    printf("	  lw $fp, 0($fp)        # restore saved fp\n");
     printf("	  jr $ra                # return from function\n");
     printf("\n");
     printf("\n");
     printf("\n");
     printf("  _ReadLine:\n");
-    printf("	  subu $sp, $sp, 8      # decrement sp to make space to save ra, fp\n");
-    printf("	  sw $fp, 8($sp)        # save fp\n");
-    printf("	  sw $ra, 4($sp)        # save ra\n");
-    printf("	  addiu $fp, $sp, 8     # set up new fp\n");
     printf("	  li $a0, 101\n");
     printf("	  li $v0, 9\n");
     printf("	  syscall\n");
@@ -184,9 +126,5 @@ void SysCallCodeGen()
     printf("	  sb $0,-2($a0)         # Add the terminating character in its place\n");
     printf("  Lrunt20:\n");
     printf("	# EndFunc\n");
-    printf("	# (below handles reaching end of fn body with no explicit return)\n");
-    printf("	  move $sp, $fp         # pop callee frame off stack\n");
-    printf("	  lw $ra, -4($fp)       # restore saved ra\n");
-    printf("	  lw $fp, 0($fp)        # restore saved fp\n");
     printf("	  jr $ra                # return from function\n");
 }
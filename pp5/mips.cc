@@ -47,11 +47,12 @@ static bool LocationsAreSame(Location *var1, Location *var2)
 void Mips::SpillRegister(Location *dst, Register reg)
 {
   Assert(dst);
-  const char *offsetFromWhere = dst->GetSegment() == fpRelative? regs[fp].name : regs[gp].name;
-  Assert(dst->GetOffset() % 4 == 0); // all variables are 4 bytes in size
+  const char *offsetFromWhere = dst->GetSegment() == fpRelative? regs[frameBase].name : regs[gp].name;
+  int offset = dst->GetOffset() + (dst->GetSegment() == fpRelative ? frameBias : 0);
+  Assert(offset % 4 == 0); // all variables are 4 bytes in size
   Emit("sw %s, %d(%s)\t# spill %s from %s to %s%+d", regs[reg].name,
-       dst->GetOffset(), offsetFromWhere, dst->GetName(), regs[reg].name,
-       offsetFromWhere,dst->GetOffset());
+       offset, offsetFromWhere, dst->GetName(), regs[reg].name,
+       offsetFromWhere, offset);
 }
 
 /* Method: FillRegister
@@ -62,11 +63,12 @@ void Mips::SpillRegister(Location *dst, Register reg)
 void Mips::FillRegister(Location *src, Register reg)
 {
   Assert(src);
-  const char *offsetFromWhere = src->GetSegment() == fpRelative? regs[fp].name : regs[gp].name;
-  Assert(src->GetOffset() % 4 == 0); // all variables are 4 bytes in size
+  const char *offsetFromWhere = src->GetSegment() == fpRelative? regs[frameBase].name : regs[gp].name;
+  int offset = src->GetOffset() + (src->GetSegment() == fpRelative ? frameBias : 0);
+  Assert(offset % 4 == 0); // all variables are 4 bytes in size
   Emit("lw %s, %d(%s)\t# fill %s to %s from %s%+d", regs[reg].name,
-       src->GetOffset(), offsetFromWhere, src->GetName(), regs[reg].name,
-       offsetFromWhere,src->GetOffset());
+       offset, offsetFromWhere, src->GetName(), regs[reg].name,
+       offsetFromWhere, offset);
 }
 
 
@@ -147,6 +149,10 @@ void Mips::EmitLoadLabel(Location *dst, const char *label)
  */
 void Mips::EmitCopy(Location *dst, Location *src)
 {
+  if (!src->GetRegister() && dst->GetRegister()) {
+    FillRegister(src, dst->GetRegister());   // load straight into dst
+    return;
+  }
   Register reg = src->GetRegister() ? src->GetRegister() : rd;
   if (!src->GetRegister()) FillRegister(src, reg);
   if (dst->GetRegister())
@@ -215,6 +221,82 @@ void Mips::EmitBinaryOp(OpCode code, Location *dst,
 }
 
 
+/* Method: EmitBinaryOp
+ * --------------------
+ * The form of a binary operation whose second operand is a constant.
+ * Emits the register-immediate instruction for the op when it has one
+ * (a subtraction is an addiu of the negated constant, and x <= c is
+ * x < c+1), otherwise the register form with $zero as the constant,
+ * which HasImmediateForm only allows for 0.
+ */
+void Mips::EmitBinaryOp(OpCode code, Location *dst, Location *op1, int immediate)
+{
+  Assert(HasImmediateForm(code, immediate));
+  Register reg = dst->GetRegister() ? dst->GetRegister() : rd;
+  Register reg1 = op1->GetRegister() ? op1->GetRegister() : rs;
+  if (!op1->GetRegister()) FillRegister(op1, reg1);
+  if (code == Sub) {
+    code = Add;
+    immediate = -immediate;
+  } else if (code == Le) {
+    code = Less;
+    immediate++;
+  }
+  if (immediateName[code])
+    Emit("%s %s, %s, %d\t", immediateName[code], regs[reg].name,
+	 regs[reg1].name, immediate);
+  else
+    Emit("%s %s, %s, %s\t", NameForTac(code), regs[reg].name,
+	 regs[reg1].name, regs[zero].name);
+  if (!dst->GetRegister()) SpillRegister(dst, reg);
+}
+
+
+/* Method: EmitUnaryOp
+ * -------------------
+ * Negation and logical not. Bools are always 0 or 1, so not is an xor
+ * with 1.
+ */
+void Mips::EmitUnaryOp(OpCode code, Location *dst, Location *op)
+{
+  Register reg = dst->GetRegister() ? dst->GetRegister() : rd;
+  Register reg1 = op->GetRegister() ? op->GetRegister() : rs;
+  if (!op->GetRegister()) FillRegister(op, reg1);
+  if (code == Not)
+    Emit("xori %s, %s, 1\t", regs[reg].name, regs[reg1].name);
+  else
+    Emit("%s %s, %s\t", NameForTac(code), regs[reg].name, regs[reg1].name);
+  if (!dst->GetRegister()) SpillRegister(dst, reg);
+}
+
+
+/* Method: HasImmediateForm
+ * ------------------------
+ * Whether EmitBinaryOp can take the constant second operand directly,
+ * so the Tac generator knows when not to load it into a register.
+ */
+bool Mips::HasImmediateForm(OpCode code, int immediate)
+{
+  const int min16 = -32768, max16 = 32767;
+  switch (code) {
+    case Add: case Less:
+      return immediate >= min16 && immediate <= max16;
+    case Sub:
+      return immediate > min16 && immediate <= max16 + 1;
+    case Le:
+      return immediate >= min16 - 1 && immediate < max16;
+    case And: case Or:                  // zero-extended
+      return immediate >= 0 && immediate <= 0xffff;
+    case Sll:
+      return immediate >= 0 && immediate < 32;
+    case Neg: case Not:
+      return false;
+    default:
+      return immediate == 0;
+  }
+}
+
+
 /* Method: EmitLabel
  * -----------------
  * Used to emit label marker. Before a label, we spill all registers since
@@ -257,19 +339,49 @@ void Mips::EmitIfZ(Location *test, const char *label)
 }
 
 
+/* Method: EmitBranch
+ * ------------------
+ * Used for a branch on the comparison of two variables, or of a
+ * variable and a constant, fusing the compare into the branch. A
+ * compare against 0 uses the single-register forms (beqz, bltz, etc).
+ */
+void Mips::EmitBranch(OpCode code, Location *op1, Location *op2, const char *label)
+{
+  Assert(branchName[code] != NULL);
+  Register reg1 = op1->GetRegister() ? op1->GetRegister() : rs;
+  Register reg2 = op2->GetRegister() ? op2->GetRegister() : rt;
+  if (!op1->GetRegister()) FillRegister(op1, reg1);
+  if (!op2->GetRegister()) FillRegister(op2, reg2);
+  Emit("%s %s, %s, %s\t# branch if %s %s %s", branchName[code], regs[reg1].name,
+       regs[reg2].name, label, op1->GetName(), branchName[code] + 1, op2->GetName());
+}
+
+void Mips::EmitBranch(OpCode code, Location *op1, int immediate, const char *label)
+{
+  Assert(branchName[code] != NULL);
+  Register reg1 = op1->GetRegister() ? op1->GetRegister() : rs;
+  if (!op1->GetRegister()) FillRegister(op1, reg1);
+  if (immediate == 0)
+    Emit("%s %s, %s\t# branch if %s %s 0", branchZeroName[code], regs[reg1].name,
+	 label, op1->GetName(), branchName[code] + 1);
+  else
+    Emit("%s %s, %d, %s\t# branch if %s %s %d", branchName[code], regs[reg1].name,
+	 immediate, label, op1->GetName(), branchName[code] + 1, immediate);
+}
+
+
 /* Method: EmitParam
  * -----------------
- * Used to push a parameter on the stack in anticipation of upcoming
- * function call. Decrements the stack pointer by 4. Slaves argument into
- * register and then stores contents to location just made at end of
- * stack.
+ * Used to pass a parameter on the stack in anticipation of upcoming
+ * function call. The space was reserved once by EmitBeginFunction, so
+ * this just slaves the argument into a register and stores it offset
+ * bytes above the stack pointer, where the callee finds it at $fp+offset.
  */
-void Mips::EmitParam(Location *arg)
+void Mips::EmitParam(Location *arg, int offset)
 {
   Register reg = arg->GetRegister() ? arg->GetRegister() : rs;
-  Emit("subu $sp, $sp, 4\t# decrement sp to make space for param");
   if (!arg->GetRegister()) FillRegister(arg, reg);
-  Emit("sw %s, 4($sp)\t# copy param value to stack", regs[reg].name);
+  Emit("sw %s, %d($sp)\t# copy param value to stack", regs[reg].name, offset);
 }
 
 
@@ -309,15 +421,6 @@ void Mips::EmitACall(Location *dst, Location *fn)
   EmitCallInstr(dst, regs[reg].name, false);
 }
 
-/*
- * We remove all parameters from the stack after a completed call
- * by adjusting the stack pointer upwards.
- */
-void Mips::EmitPopParams(int bytes)
-{
-  if (bytes != 0)
-    Emit("add $sp, $sp, %d\t# pop params off stack", bytes);
-}
 
 
 /* Method: EmitReturn
@@ -344,9 +447,20 @@ void Mips::EmitPopParams(int bytes)
 	     regs[returnVal->GetRegister()].name);
       else FillRegister(returnVal, v0);
     }
-  Emit("move $sp, $fp\t\t# pop callee frame off stack");
-  Emit("lw $ra, -4($fp)\t# restore saved ra");
-  Emit("lw $fp, 0($fp)\t# restore saved fp");
+  for (int r = s0; r <= fp; r++)
+    if (savedRegs & (1u << r))
+      Emit("lw %s, %d(%s)\t# restore callee-saved %s", regs[r].name,
+           savedOffset[r] + frameBias, regs[frameBase].name, regs[r].name);
+  if (frameKind != NoFrame && omitFramePointer) {
+    if (frameKind == FullFrame)
+      Emit("lw $ra, %d($sp)\t# restore saved ra", frameBias - 4);
+    Emit("addiu $sp, $sp, %d\t# pop callee frame off stack", frameBias);
+  } else if (frameKind != NoFrame) {
+    Emit("move $sp, $fp\t\t# pop callee frame off stack");
+    if (frameKind == FullFrame)
+      Emit("lw $ra, -4($fp)\t# restore saved ra");
+    Emit("lw $fp, 0($fp)\t# restore saved fp");
+  }
   Emit("jr $ra\t\t# return from function");
 }
 
@@ -357,19 +471,53 @@ void Mips::EmitPopParams(int bytes)
  * upon entering a new function. We decrement the $sp to make space
  * and then save the current values of $fp and $ra (since we are
  * going to change them), then set up the $fp and bump the $sp down
- * to make space for all our locals/temps.
+ * to make space for all our locals/temps. The callee-saved registers
+ * the function uses (calleeSaved is a mask of them) get the words just
+ * below the locals, and are restored by EmitReturn. Below them is the
+ * outgoing-argument area of outgoingSize bytes that EmitParam stores
+ * into, so $sp doesn't move again until the function returns. The
+ * whole frame is made with one $sp adjustment. A LeafFrame leaves the
+ * $ra slot alone, and a NoFrame function (no calls, no frame, nothing
+ * read through $fp) gets no prologue at all.
+ *
+ * With -fomit-frame-pointer the frame is laid out the same way, but
+ * $fp is neither saved nor set up: since $sp is fixed for the whole
+ * body, every $fp offset is addressed as that offset plus the frame
+ * size from $sp (and $fp is just another callee-saved register).
  */
-void Mips::EmitBeginFunction(int stackFrameSize)
+void Mips::EmitBeginFunction(int stackFrameSize, unsigned int calleeSaved, int outgoingSize,
+                             FrameKind kind)
 {
-  Assert(stackFrameSize >= 0);
-  Emit("subu $sp, $sp, 8\t# decrement sp to make space to save ra, fp");
-  Emit("sw $fp, 8($sp)\t# save fp");
-  Emit("sw $ra, 4($sp)\t# save ra");
-  Emit("addiu $fp, $sp, 8\t# set up new fp");
-
-  if (stackFrameSize != 0)
-    Emit("subu $sp, $sp, %d\t# decrement sp to make space for locals/temps",
-	   stackFrameSize);
+  Assert(stackFrameSize >= 0 && outgoingSize >= 0);
+  Assert(kind != NoFrame || (stackFrameSize == 0 && outgoingSize == 0 && calleeSaved == 0));
+  frameKind = kind;
+  savedRegs = 0;
+  frameBase = omitFramePointer ? sp : fp;
+  frameBias = 0;
+  if (kind == NoFrame)
+    return;
+
+  int total = 8 + stackFrameSize + outgoingSize;
+  Emit("subu $sp, $sp, %d\t# decrement sp to make space for ra, fp, locals/temps", total);
+  if (!omitFramePointer)
+    Emit("sw $fp, %d($sp)\t# save fp", total);
+  if (kind == FullFrame)
+    Emit("sw $ra, %d($sp)\t# save ra", total - 4);
+  if (omitFramePointer)
+    frameBias = total;
+  else
+    Emit("addiu $fp, $sp, %d\t# set up new fp", total);
+
+  savedRegs = calleeSaved;
+  int offset = -4 - stackFrameSize;
+  for (int r = fp; r >= s0; r--)
+    if (savedRegs & (1u << r)) {
+      Assert(IsCalleeSaved(Register(r)));
+      savedOffset[r] = offset;
+      offset += 4;
+      Emit("sw %s, %d(%s)\t# save callee-saved %s", regs[r].name,
+           savedOffset[r] + frameBias, regs[frameBase].name, regs[r].name);
+    }
 }
 
 
@@ -445,9 +593,33 @@ Mips::Mips() {
   mipsName[Div] = "div";
   mipsName[Mod] = "rem";
   mipsName[Eq] = "seq";
+  mipsName[Ne] = "sne";
   mipsName[Less] = "slt";
+  mipsName[Le] = "sle";
+  mipsName[Gt] = "sgt";
+  mipsName[Ge] = "sge";
   mipsName[And] = "and";
   mipsName[Or] = "or";
+  mipsName[Sll] = "sllv";
+  mipsName[Neg] = "negu";
+  mipsName[Not] = "xori";
+  immediateName[Add] = "addiu";
+  immediateName[Less] = "slti";
+  immediateName[And] = "andi";
+  immediateName[Or] = "ori";
+  immediateName[Sll] = "sll";
+  branchName[Eq] = "beq";
+  branchName[Ne] = "bne";
+  branchName[Less] = "blt";
+  branchName[Le] = "ble";
+  branchName[Gt] = "bgt";
+  branchName[Ge] = "bge";
+  branchZeroName[Eq] = "beqz";
+  branchZeroName[Ne] = "bnez";
+  branchZeroName[Less] = "bltz";
+  branchZeroName[Le] = "blez";
+  branchZeroName[Gt] = "bgtz";
+  branchZeroName[Ge] = "bgez";
   regs[zero] = (RegContents){"$zero", false};
   regs[at] = (RegContents){"$at", false};
   regs[v0] = (RegContents){"$v0", false};
@@ -481,16 +653,24 @@ Mips::Mips() {
   regs[s6] = (RegContents){"$s6", true};
   regs[s7] = (RegContents){"$s7", true};
   rs = v0; rt = v1; rd = v0;
+  savedRegs = 0;
+  frameKind = FullFrame;
+  omitFramePointer = IsOptionOn("omit-frame-pointer");
+  frameBase = fp;
+  frameBias = 0;
 }
 const char *Mips::mipsName[NumOps];
+const char *Mips::immediateName[NumOps];
+const char *Mips::branchName[NumOps];
+const char *Mips::branchZeroName[NumOps];
 
 void Mips::SaveCaller(Location *location) {
-    if (location->GetRegister())
+    if (location->GetRegister() && !IsCalleeSaved(location->GetRegister()))
 	SpillRegister(location, location->GetRegister());
 }
 
 void Mips::RestoreCaller(Location *location) {
-    if (location->GetRegister())
+    if (location->GetRegister() && !IsCalleeSaved(location->GetRegister()))
 	FillRegister(location, location->GetRegister());
 }
 
@@ -25,12 +25,13 @@ class Location;
 
 class Mips {
   public:
-    typedef enum {Add, Sub, Mul, Div, Mod, Eq, Less, And, Or, NumOps} OpCode;
+    typedef enum {Add, Sub, Mul, Div, Mod, Eq, Ne, Less, Le, Gt, Ge, And, Or,
+                  Sll, Neg, Not, NumOps} OpCode;
 
     /*
      * Chun says: t0-t9, s0-s7 general purpose (use these)
      * v0, v1 are return value registers, v1 is never used in decaf (32 bit)
-     * a0-a3 are used for built in functions, save/restore them before use
+     * a0-a3 carry the first four arguments of every call
      */
     typedef enum {zero, at, v0, v1, a0, a1, a2, a3,
 			t0, t1, t2, t3, t4, t5, t6, t7,
@@ -39,6 +40,15 @@ class Mips {
 
     static const int NumGeneralPurposeRegs = 18;
 
+    // How much of the standard frame a function sets up: all of it,
+    // everything but the $ra slot (it makes no calls), or nothing at
+    // all (no calls and nothing in memory, so $fp isn't needed either)
+    typedef enum {FullFrame, LeafFrame, NoFrame} FrameKind;
+
+    // s0-s7 survive calls, the callee saves them if it uses them. So
+    // does $fp, which is only allocated when the frame pointer is omitted.
+    static bool IsCalleeSaved(Register r) { return (r >= s0 && r <= s7) || r == fp; }
+
   private:
     struct RegContents {
 	const char *name;
@@ -47,6 +57,19 @@ class Mips {
 
     Register rs, rt, rd;
 
+    // Callee-saved registers the current function uses, and the
+    // frame offsets they are saved at (set up by EmitBeginFunction)
+    unsigned int savedRegs;
+    int savedOffset[NumRegs];
+    FrameKind frameKind;
+
+    // Register the fpRelative Locations are addressed from, and what
+    // to add to their offsets: $fp and 0, or with the frame pointer
+    // omitted $sp and the frame size
+    bool omitFramePointer;
+    Register frameBase;
+    int frameBias;
+
     typedef enum { ForRead, ForWrite } Reason;
     
     void FillRegister(Location *src, Register reg);
@@ -55,6 +78,8 @@ class Mips {
     void EmitCallInstr(Location *dst, const char *fn, bool isL);
     
     static const char *mipsName[NumOps];
+    static const char *immediateName[NumOps];
+    static const char *branchName[NumOps], *branchZeroName[NumOps];
     static const char *NameForTac(OpCode code);
 
   public:
@@ -73,19 +98,28 @@ class Mips {
 
     void EmitBinaryOp(OpCode code, Location *dst, 
 			    Location *op1, Location *op2);
+    void EmitBinaryOp(OpCode code, Location *dst, Location *op1, int immediate);
+    void EmitUnaryOp(OpCode code, Location *dst, Location *op);
+
+    // True if "op1 code immediate" is a single instruction: one with a
+    // 16-bit immediate field (addiu, slti, andi, ori, sll) or, for a
+    // constant 0, any op with $zero as the second register
+    static bool HasImmediateForm(OpCode code, int immediate);
 
     void EmitLabel(const char *label);
     void EmitGoto(const char *label);
     void EmitIfZ(Location *test, const char*label);
+    void EmitBranch(OpCode code, Location *op1, Location *op2, const char *label);
+    void EmitBranch(OpCode code, Location *op1, int immediate, const char *label);
     void EmitReturn(Location *returnVal);
 
-    void EmitBeginFunction(int frameSize);
+    void EmitBeginFunction(int frameSize, unsigned int calleeSaved = 0, int outgoingSize = 0,
+                           FrameKind kind = FullFrame);
     void EmitEndFunction();
 
-    void EmitParam(Location *arg);
+    void EmitParam(Location *arg, int offset);
     void EmitLCall(Location *result, const char* label);
     void EmitACall(Location *result, Location *fnAddr);
-    void EmitPopParams(int bytes);
 
     void EmitVTable(const char *label, List<const char*> *methodLabels);
 
@@ -0,0 +1,1383 @@
+/* File: ssa.cc
+ * ------------
+ * Implementation of the SSAForm class.
+ */
+
+#include "ssa.h"
+#include "codegen.h"
+#include "tac.h"
+#include <limits.h>
+#include <algorithm>
+
+using namespace std;
+
+SSAForm::SSAForm(FlowGraph *g, vector<Location*> *locs,
+                 unordered_map<string, Instruction*> *l)
+  : graph(g), locations(locs), labels(l), stacks(locs->size())
+{
+    // versions go below every local the function already has
+    int lowest = CodeGenerator::OffsetToFirstLocal + CodeGenerator::VarSize;
+    for (int i = 0; i < locations->size(); i++)
+        if ((*locations)[i]->GetSegment() == fpRelative)
+            lowest = min(lowest, (*locations)[i]->GetOffset());
+    nextOffset = lowest - CodeGenerator::VarSize;
+}
+
+  // The numbered stack variables and temps. Globals and spilled slots
+  // aren't numbered, and the argument registers are machine registers.
+bool SSAForm::IsRenamed(Location *loc)
+{
+    int id = loc->GetId();
+    return id >= 0 && id < locations->size() && (*locations)[id] == loc
+        && loc->GetSegment() == fpRelative && !loc->IsPrecolored();
+}
+
+Location *SSAForm::NewVersion(Location *variable)
+{
+    static int nextVersionNum;
+    char name[64];
+    snprintf(name, sizeof(name), "%s_%d", variable->GetName(), nextVersionNum++);
+    Location *version = new Location(fpRelative, nextOffset, name);
+    nextOffset -= CodeGenerator::VarSize;
+    variableOf[version] = variable;
+    return version;
+}
+
+  // The version of variable reaching the current point of Rename. With
+  // none the variable is read before any assignment, and the original
+  // Location stands for whatever it held on entry.
+Location *SSAForm::CurrentVersion(Location *variable)
+{
+    vector<Location*> &stack = stacks[variable->GetId()];
+    return stack.empty() ? variable : stack.back();
+}
+
+  // The successor a conditional branch ending b jumps to (the other one
+  // is the block after b, which it falls through to)
+BasicBlock *SSAForm::TakenSuccessor(BasicBlock *b)
+{
+    CondBranch *branch = dynamic_cast<CondBranch*>(b->code.Nth(b->code.NumElements() - 1));
+    Assert(branch);
+    return graph->BlockFor((*labels)[branch->getLabel()]);
+}
+
+void SSAForm::Replace(BasicBlock *b, int i, Instruction *with)
+{
+    b->code.RemoveAt(i);
+    b->code.InsertAt(with, i);
+}
+
+int SSAForm::Build()
+{
+    int phis = InsertPhis();
+    Rename(graph->Entry());
+    return phis;
+}
+
+/* Method: InsertPhis
+ * ------------------
+ * Cytron et al.: a variable assigned in block b needs a phi in each
+ * block of the dominance frontier of b, and those phis are assignments
+ * too, so the frontiers of their blocks are followed as well (the
+ * iterated dominance frontier). A phi is only placed where the variable
+ * is live on entry; anywhere else it would merge values nobody reads.
+ */
+int SSAForm::InsertPhis()
+{
+    LivenessProblem liveness(locations->size());
+    liveness.Solve(graph);
+
+    int n = graph->NumBlocks();
+    vector<vector<BasicBlock*> > defSites(locations->size());
+    for (int b = 0; b < n; b++)
+    {
+        BasicBlock *block = graph->Nth(b);
+        if (!graph->IsReachable(block))
+            continue;
+        for (int i = 0; i < block->code.NumElements(); i++)
+        {
+            BitVector &kill = block->code.Nth(i)->kill;
+            for (int v = kill.NextSet(0); v != -1; v = kill.NextSet(v+1))
+                if (IsRenamed((*locations)[v]) && (defSites[v].empty() || defSites[v].back() != block))
+                    defSites[v].push_back(block);
+        }
+    }
+
+    int placed = 0;
+    for (int v = 0; v < locations->size(); v++)
+    {
+        vector<bool> hasPhi(n, false), queued(n, false);
+        vector<BasicBlock*> worklist = defSites[v];
+        for (int i = 0; i < worklist.size(); i++)
+            queued[worklist[i]->id] = true;
+        while (!worklist.empty())
+        {
+            BasicBlock *b = worklist.back();
+            worklist.pop_back();
+            for (int f = 0; f < b->frontier.NumElements(); f++)
+            {
+                BasicBlock *join = b->frontier.Nth(f);
+                if (hasPhi[join->id] || !liveness.in[join->id].Test(v))
+                    continue;
+                int at = 0;
+                while (at < join->code.NumElements() && (dynamic_cast<Label*>(join->code.Nth(at))
+                                                         || dynamic_cast<Phi*>(join->code.Nth(at))))
+                    at++;
+                Phi *phi = new Phi((*locations)[v], join->preds.NumElements());
+                join->code.InsertAt(phi, at);
+                phiVariable[phi] = (*locations)[v];
+                hasPhi[join->id] = true;
+                placed++;
+                if (!queued[join->id])
+                {
+                    queued[join->id] = true;
+                    worklist.push_back(join);
+                }
+            }
+        }
+    }
+    return placed;
+}
+
+/* Method: Rename
+ * --------------
+ * Walks the dominator tree from b keeping a stack of versions per
+ * variable: each use is renamed to the version on top, each definition
+ * pushes a new one, and the phis of the successors get the versions
+ * that flow out of b along the edge. The definitions of b are popped
+ * again once its subtree is done.
+ */
+void SSAForm::Rename(BasicBlock *b)
+{
+    vector<Location*> pushed;
+    for (int i = 0; i < b->code.NumElements(); i++)
+    {
+        Instruction *instruction = b->code.Nth(i);
+        if (!dynamic_cast<Phi*>(instruction))
+        {
+            List<Location*> uses = instruction->GenSet();
+            for (int j = 0; j < uses.NumElements(); j++)
+                if (IsRenamed(uses.Nth(j)))
+                    instruction->RenameUse(uses.Nth(j), CurrentVersion(uses.Nth(j)));
+        }
+        List<Location*> defs = instruction->KillSet();
+        for (int j = 0; j < defs.NumElements(); j++)
+        {
+            Location *variable = defs.Nth(j);
+            if (!IsRenamed(variable))
+                continue;
+            Location *version = NewVersion(variable);
+            instruction->RenameDef(variable, version);
+            stacks[variable->GetId()].push_back(version);
+            pushed.push_back(variable);
+        }
+    }
+
+    for (int s = 0; s < b->succs.NumElements(); s++)
+    {
+        BasicBlock *succ = b->succs.Nth(s);
+        int k = 0;
+        while (succ->preds.Nth(k) != b)
+            k++;
+        for (int i = 0; i < succ->code.NumElements(); i++)
+        {
+            Phi *phi = dynamic_cast<Phi*>(succ->code.Nth(i));
+            if (phi)
+                phi->SetArg(k, CurrentVersion(phiVariable[phi]));
+            else if (!dynamic_cast<Label*>(succ->code.Nth(i)))
+                break;
+        }
+    }
+
+    for (int c = 0; c < b->children.NumElements(); c++)
+        Rename(b->children.Nth(c));
+    for (int i = 0; i < pushed.size(); i++)
+        stacks[pushed[i]->GetId()].pop_back();
+}
+
+
+  // The comparisons, with the semantics of the MIPS set/branch
+  // instructions
+static bool Compare(Mips::OpCode code, int a, int b)
+{
+    switch (code)
+    {
+        case Mips::Eq:      return a == b;
+        case Mips::Ne:      return a != b;
+        case Mips::Less:    return a < b;
+        case Mips::Le:      return a <= b;
+        case Mips::Gt:      return a > b;
+        case Mips::Ge:      return a >= b;
+        default:            Failure("Not a comparison: %d", code); return false;
+    }
+}
+
+  // Computes "a code b" the way the generated code would, in 32-bit
+  // two's complement. Returns false for the divisions that trap (or
+  // whose result the machine leaves undefined), which are left to run.
+static bool Fold(Mips::OpCode code, int a, int b, int &result)
+{
+    unsigned int x = a, y = b;
+    switch (code)
+    {
+        case Mips::Add:     result = x + y; return true;
+        case Mips::Sub:     result = x - y; return true;
+        case Mips::Mul:     result = x * y; return true;
+        case Mips::Div:
+        case Mips::Mod:
+            if (b == 0 || (a == INT_MIN && b == -1))
+                return false;
+            result = (code == Mips::Div) ? a / b : a % b;
+            return true;
+        case Mips::And:     result = x & y; return true;
+        case Mips::Or:      result = x | y; return true;
+        case Mips::Sll:     result = x << (y & 31); return true;
+        case Mips::Neg:     result = 0u - x; return true;
+        case Mips::Not:     result = x ^ 1; return true;
+        default:            result = Compare(code, a, b); return true;
+    }
+}
+
+SSAForm::Value SSAForm::ValueOf(Location *loc)
+{
+    if (!IsVersion(loc))
+        return Value(Value::Bottom);
+    return values[loc];
+}
+
+  // The lattice meet: Top gives way to anything, two different
+  // constants to Bottom
+static SSAForm::Value Meet(SSAForm::Value a, SSAForm::Value b)
+{
+    if (a.level == SSAForm::Value::Top)
+        return b;
+    if (b.level == SSAForm::Value::Top)
+        return a;
+    if (a.level == SSAForm::Value::Constant && b.level == SSAForm::Value::Constant
+        && a.constant == b.constant)
+        return a;
+    return SSAForm::Value(SSAForm::Value::Bottom);
+}
+
+  // Applies code to two lattice values (b is ignored for a unary op)
+static SSAForm::Value Apply(Mips::OpCode code, SSAForm::Value a, SSAForm::Value b)
+{
+    if (BinaryOp::IsUnary(code))
+        b = SSAForm::Value(SSAForm::Value::Constant, 0);
+    if (a.level == SSAForm::Value::Bottom || b.level == SSAForm::Value::Bottom)
+        return SSAForm::Value(SSAForm::Value::Bottom);
+    if (a.level == SSAForm::Value::Top || b.level == SSAForm::Value::Top)
+        return SSAForm::Value(SSAForm::Value::Top);
+    int result;
+    if (!Fold(code, a.constant, b.constant, result))
+        return SSAForm::Value(SSAForm::Value::Bottom);
+    return SSAForm::Value(SSAForm::Value::Constant, result);
+}
+
+  // The value instruction gives the Locations it defines, or for a
+  // conditional branch 1 if it's taken and 0 if not
+SSAForm::Value SSAForm::Evaluate(Instruction *instruction, BasicBlock *b)
+{
+    LoadConstant *constant = dynamic_cast<LoadConstant*>(instruction);
+    Assign *assign = dynamic_cast<Assign*>(instruction);
+    BinaryOp *op = dynamic_cast<BinaryOp*>(instruction);
+    Phi *phi = dynamic_cast<Phi*>(instruction);
+    IfZ *ifz = dynamic_cast<IfZ*>(instruction);
+    IfCompare *cmp = dynamic_cast<IfCompare*>(instruction);
+    if (constant)
+        return Value(Value::Constant, constant->GetValue());
+    if (assign)
+        return ValueOf(assign->GetSrc());
+    if (op)
+        return Apply(op->GetOpCode(), ValueOf(op->GetOp1()), op->GetOp2()
+                     ? ValueOf(op->GetOp2()) : Value(Value::Constant, op->GetImmediate()));
+    if (ifz)
+        return Apply(Mips::Eq, ValueOf(ifz->GetTest()), Value(Value::Constant, 0));
+    if (cmp)
+        return Apply(cmp->GetOpCode(), ValueOf(cmp->GetOp1()), cmp->GetOp2()
+                     ? ValueOf(cmp->GetOp2()) : Value(Value::Constant, cmp->GetImmediate()));
+    if (phi)
+    {
+        Value result;
+        for (int k = 0; k < phi->NumArgs(); k++)
+            if (executableEdges.count(make_pair(b->preds.Nth(k)->id, b->id)))
+                result = Meet(result, ValueOf(phi->GetArg(k)));
+        return result;
+    }
+    return Value(Value::Bottom);
+}
+
+/* Method: PropagateConstants
+ * --------------------------
+ * Wegman and Zadeck's sparse conditional constant propagation. Every
+ * version starts at Top and only moves down the lattice. Two worklists
+ * drive it: flow edges that became executable (a block is evaluated in
+ * full the first time it's reached, its phis on every new edge in), and
+ * instructions whose operands changed value. A conditional branch with
+ * a constant outcome only makes one of its edges executable, so code
+ * behind a branch that never goes that way doesn't spoil the values
+ * merged after it.
+ *
+ * Then, in the blocks found executable: a pure instruction computing a
+ * constant becomes a LoadConstant, a constant operand of a BinaryOp or
+ * IfCompare becomes its immediate, and a branch that always goes the
+ * same way becomes a Goto (or goes, if it always falls through). The
+ * code it leaves unreachable is removed by simplifyControlFlow.
+ */
+int SSAForm::PropagateConstants()
+{
+    int n = graph->NumBlocks();
+    unordered_map<Instruction*, BasicBlock*> blockOf;   // phis included
+    unordered_map<Location*, vector<Instruction*> > usersOf;
+    for (int b = 0; b < n; b++)
+    {
+        BasicBlock *block = graph->Nth(b);
+        for (int i = 0; i < block->code.NumElements(); i++)
+        {
+            Instruction *instruction = block->code.Nth(i);
+            blockOf[instruction] = block;
+            List<Location*> uses = instruction->GenSet();
+            for (int j = 0; j < uses.NumElements(); j++)
+                if (IsVersion(uses.Nth(j)))
+                    usersOf[uses.Nth(j)].push_back(instruction);
+        }
+    }
+
+    vector<bool> executable(n, false);
+    vector<pair<BasicBlock*, BasicBlock*> > flowWork;
+    vector<Instruction*> ssaWork;
+    flowWork.push_back(make_pair((BasicBlock*)NULL, graph->Entry()));
+    while (!flowWork.empty() || !ssaWork.empty())
+    {
+        if (ssaWork.empty())
+        {
+            BasicBlock *from = flowWork.back().first, *to = flowWork.back().second;
+            flowWork.pop_back();
+            if (from && !executableEdges.insert(make_pair(from->id, to->id)).second)
+                continue;
+            bool first = !executable[to->id];
+            executable[to->id] = true;
+            for (int i = to->code.NumElements() - 1; i >= 0; i--)
+                if (first || dynamic_cast<Phi*>(to->code.Nth(i)))
+                    ssaWork.push_back(to->code.Nth(i));
+            if (first && !dynamic_cast<CondBranch*>(to->code.Nth(to->code.NumElements() - 1)))
+                for (int s = 0; s < to->succs.NumElements(); s++)
+                    flowWork.push_back(make_pair(to, to->succs.Nth(s)));
+            continue;
+        }
+
+        Instruction *instruction = ssaWork.back();
+        ssaWork.pop_back();
+        BasicBlock *b = blockOf[instruction];
+        if (!executable[b->id])
+            continue;
+        Value result = Evaluate(instruction, b);
+        if (dynamic_cast<CondBranch*>(instruction))
+        {
+            BasicBlock *taken = TakenSuccessor(b);
+            BasicBlock *next = b->id + 1 < n ? graph->Nth(b->id + 1) : NULL;
+            if (result.level == Value::Bottom || (result.level == Value::Constant && result.constant))
+                flowWork.push_back(make_pair(b, taken));
+            if (next && (result.level == Value::Bottom
+                         || (result.level == Value::Constant && !result.constant)))
+                flowWork.push_back(make_pair(b, next));
+            continue;
+        }
+        List<Location*> defs = instruction->KillSet();
+        for (int j = 0; j < defs.NumElements(); j++)
+        {
+            Location *def = defs.Nth(j);
+            if (!IsVersion(def))
+                continue;
+            Value old = values[def];
+            Value lowered = Meet(old, result);
+            if (lowered.level == old.level && lowered.constant == old.constant)
+                continue;
+            values[def] = lowered;
+            vector<Instruction*> &users = usersOf[def];
+            ssaWork.insert(ssaWork.end(), users.begin(), users.end());
+        }
+    }
+
+    int folded = 0, immediates = 0, branches = 0;
+    for (int b = 0; b < n; b++)
+    {
+        BasicBlock *block = graph->Nth(b);
+        if (!executable[b])
+            continue;
+        for (int i = 0; i < block->code.NumElements(); i++)
+        {
+            Instruction *instruction = block->code.Nth(i);
+            List<Location*> defs = instruction->KillSet();
+            if (instruction->isPure() && defs.NumElements() == 1 && !dynamic_cast<LoadConstant*>(instruction)
+                && ValueOf(defs.Nth(0)).level == Value::Constant)
+            {
+                Replace(block, i, new LoadConstant(defs.Nth(0), ValueOf(defs.Nth(0)).constant));
+                folded++;
+                continue;
+            }
+
+            BinaryOp *op = dynamic_cast<BinaryOp*>(instruction);
+            IfCompare *cmp = dynamic_cast<IfCompare*>(instruction);
+            Mips::OpCode code;
+            Location *op1, *op2;
+            if (op && op->GetOp2())
+                code = op->GetOpCode(), op1 = op->GetOp1(), op2 = op->GetOp2();
+            else if (cmp && cmp->GetOp2())
+                code = cmp->GetOpCode(), op1 = cmp->GetOp1(), op2 = cmp->GetOp2();
+            else
+                continue;
+            if (ValueOf(op1).level == Value::Constant && ValueOf(op2).level != Value::Constant
+                && BinaryOp::Swapped(code) != Mips::NumOps)
+            {
+                swap(op1, op2);
+                code = BinaryOp::Swapped(code);
+            }
+            if (ValueOf(op2).level != Value::Constant)
+                continue;
+            int value = ValueOf(op2).constant;
+            if (cmp)
+                Replace(block, i, new IfCompare(code, op1, value, cmp->getLabel().c_str()));
+            else
+            {
+                if (code == Mips::Mul && value > 0 && !(value & (value - 1)))
+                {
+                    code = Mips::Sll;
+                    value = __builtin_ctz(value);
+                }
+                if (!Mips::HasImmediateForm(code, value))
+                    continue;
+                Replace(block, i, new BinaryOp(code, op->GetDst(), op1, value));
+            }
+            immediates++;
+        }
+
+        int last = block->code.NumElements() - 1;
+        CondBranch *branch = dynamic_cast<CondBranch*>(block->code.Nth(last));
+        if (!branch)
+            continue;
+        BasicBlock *taken = TakenSuccessor(block);
+        BasicBlock *next = b + 1 < n ? graph->Nth(b + 1) : NULL;
+        bool jumps = executableEdges.count(make_pair(b, taken->id)) > 0;
+        bool fallsThrough = next && executableEdges.count(make_pair(b, next->id)) > 0;
+        if (taken == next || jumps == fallsThrough)
+            continue;
+        if (jumps)
+            Replace(block, last, new Goto(branch->getLabel().c_str()));
+        else
+            block->code.RemoveAt(last);
+        branches++;
+    }
+    return folded + immediates + branches;
+}
+
+  // Follows a chain of copies to the value at its start
+static Location *Resolve(unordered_map<Location*, Location*> &copyOf, Location *loc)
+{
+    unordered_map<Location*, Location*>::iterator it;
+    while ((it = copyOf.find(loc)) != copyOf.end())
+        loc = it->second;
+    return loc;
+}
+
+/* Method: PropagateCopies
+ * -----------------------
+ * In SSA form a copy "v = x" means v and x hold the same value wherever
+ * v is used, so the uses can read x and the copy goes. The same holds
+ * for a phi all of whose arguments are x or the phi itself. Removing
+ * a phi can make others trivial, so the scan repeats until nothing new
+ * is found. Copies from the argument registers and from memory aren't
+ * touched: those Locations change under the function's feet.
+ */
+int SSAForm::PropagateCopies()
+{
+    unordered_map<Location*, Location*> copyOf;
+    int removed = 0;
+    bool changed = true;
+    while (changed)
+    {
+        changed = false;
+        for (int b = 0; b < graph->NumBlocks(); b++)
+        {
+            BasicBlock *block = graph->Nth(b);
+            for (int i = 0; i < block->code.NumElements(); i++)
+            {
+                Instruction *instruction = block->code.Nth(i);
+                Assign *assign = dynamic_cast<Assign*>(instruction);
+                Phi *phi = dynamic_cast<Phi*>(instruction);
+                Location *dst = NULL, *src = NULL;
+                if (instruction->removed)
+                    continue;
+                if (assign)
+                {
+                    dst = assign->GetDst();
+                    src = Resolve(copyOf, assign->GetSrc());
+                }
+                else if (phi)
+                {
+                    dst = phi->GetDst();
+                    for (int k = 0; k < phi->NumArgs() && dst; k++)
+                    {
+                        Location *arg = Resolve(copyOf, phi->GetArg(k));
+                        if (arg == dst)
+                            continue;
+                        if (src && arg != src)
+                            dst = NULL;
+                        src = arg;
+                    }
+                }
+                if (!dst || !src || !IsVersion(dst) || (!IsVersion(src) && !IsRenamed(src)))
+                    continue;
+                copyOf[dst] = src;
+                instruction->removed = true;
+                removed++;
+                changed = true;
+            }
+        }
+    }
+
+    RenameUses(copyOf);
+    return removed;
+}
+
+  // Makes every use of a version in copyOf read the value it stands for,
+  // and sweeps out the instructions that defined them
+void SSAForm::RenameUses(unordered_map<Location*, Location*> &copyOf)
+{
+    for (int b = 0; b < graph->NumBlocks(); b++)
+    {
+        BasicBlock *block = graph->Nth(b);
+        for (int i = 0; i < block->code.NumElements(); i++)
+        {
+            Instruction *instruction = block->code.Nth(i);
+            List<Location*> uses = instruction->GenSet();
+            for (int j = 0; j < uses.NumElements(); j++)
+                if (copyOf.count(uses.Nth(j)))
+                    instruction->RenameUse(uses.Nth(j), Resolve(copyOf, uses.Nth(j)));
+        }
+    }
+    graph->Compact();
+}
+
+/* Method: NumberValues
+ * --------------------
+ * Dominator-based value numbering, after Briggs, Cooper and Simpson. In
+ * SSA form a version names a single value, so an expression is known by
+ * its operator and the versions it reads. A table scoped to the
+ * dominator tree maps each expression computed on the way down to the
+ * version holding it, and an instruction computing one already in the
+ * table is dropped for that version. Operands of commutative ops (and
+ * of comparisons, flipped as needed) are put in a fixed order first, so
+ * "a + b" and "b + a" or "a < b" and "b > a" meet in the table.
+ * Constants and labels are left alone: loading one again is a single
+ * instruction, cheaper than keeping it in a register (or saving it
+ * around calls) all the way from the first.
+ *
+ * A Load also reads memory, so its key includes the generation of the
+ * memory it reads (see MemoryClass). A Store starts a new generation of
+ * its class and makes the stored value available to loads of the same
+ * address, so they turn into copies of it. Fields and array elements
+ * also start a new generation at each call and at each block that can
+ * be reached along more than one edge, since a store could come in
+ * along any of the others. Array lengths and vtables can't change once
+ * made, so loads of them stay available across calls and joins.
+ */
+int SSAForm::NumberValues()
+{
+    FindDefs();
+    unordered_map<Location*, Location*> copyOf;
+    unordered_map<string, Location*> available;
+    Memory memory;
+    memory.clobbered = 0;
+    int generations = 0;
+    int removed = NumberValues(graph->Entry(), memory, generations, available, copyOf);
+    RenameUses(copyOf);
+    return removed;
+}
+
+void SSAForm::FindDefs()
+{
+    defOf.clear();
+    defBlock.clear();
+    for (int b = 0; b < graph->NumBlocks(); b++)
+    {
+        BasicBlock *block = graph->Nth(b);
+        for (int i = 0; i < block->code.NumElements(); i++)
+        {
+            List<Location*> defs = block->code.Nth(i)->KillSet();
+            for (int j = 0; j < defs.NumElements(); j++)
+                if (IsVersion(defs.Nth(j)))
+                {
+                    defOf[defs.Nth(j)] = block->code.Nth(i);
+                    defBlock[defs.Nth(j)] = block;
+                }
+        }
+    }
+}
+
+  // Alias classes of memory. Object fields are told apart by their
+  // offset (a positive number, used as the class itself); the others
+  // are the classes below.
+static const int ArrayElements = 0, ArrayLengths = -1, VtablePointers = -2, Vtables = -3;
+
+  // The classes nothing writes once their memory has been handed out
+static bool IsImmutable(int memoryClass)
+{
+    return memoryClass == ArrayLengths || memoryClass == VtablePointers || memoryClass == Vtables;
+}
+
+/* Method: MemoryClass
+ * -------------------
+ * Which class of memory a Load or Store at offset from base touches.
+ * Two accesses in different classes never overlap. The address says
+ * it all in the code the generator emits: GenSubscript reaches array
+ * elements through an address it computes with a BinaryOp (nothing
+ * else points into an array), GenArrayLen reads the length 4 bytes
+ * before the array, a field is read at its positive offset from the
+ * object and the vtable pointer at offset 0, and a vtable is only read
+ * through a vtable pointer just loaded. Lengths and vtable pointers are
+ * only stored by GenNewArray and GenNew, into memory Alloc just
+ * returned, which nothing loaded earlier can point to.
+ */
+int SSAForm::MemoryClass(Location *base, int offset, unordered_map<Location*, Location*> &copyOf)
+{
+    unordered_map<Location*, Instruction*>::iterator it = defOf.find(Resolve(copyOf, base));
+    Instruction *def = (it == defOf.end()) ? NULL : it->second;
+    Load *load = dynamic_cast<Load*>(def);
+    if (load && MemoryClass(load->GetSrc(), load->GetOffset(), copyOf) == VtablePointers)
+        return Vtables;
+    if (offset > 0)
+        return offset;
+    if (offset < 0)
+        return ArrayLengths;
+    return dynamic_cast<BinaryOp*>(def) ? ArrayElements : VtablePointers;
+}
+
+  // The key of a load of memory class from offset bytes past base
+string SSAForm::LoadKey(Location *base, int offset, Memory &memory,
+                        unordered_map<Location*, Location*> &copyOf)
+{
+    int memoryClass = MemoryClass(base, offset, copyOf);
+    char key[128];
+    snprintf(key, sizeof(key), "lw %d %d %d %p %d", memoryClass,
+             IsImmutable(memoryClass) ? 0 : memory.clobbered, memory.stored[memoryClass],
+             (void*)Resolve(copyOf, base), offset);
+    return key;
+}
+
+  // The table key for what instruction computes, "" if it isn't an
+  // expression value numbering handles
+string SSAForm::ExpressionKey(Instruction *instruction, Memory &memory,
+                              unordered_map<Location*, Location*> &copyOf)
+{
+    char key[128];
+    BinaryOp *op = dynamic_cast<BinaryOp*>(instruction);
+    Load *load = dynamic_cast<Load*>(instruction);
+    if (load)
+        return LoadKey(load->GetSrc(), load->GetOffset(), memory, copyOf);
+    else if (op && !op->GetOp2())
+        snprintf(key, sizeof(key), "%d %p %d", op->GetOpCode(),
+                 (void*)Resolve(copyOf, op->GetOp1()), op->GetImmediate());
+    else if (op)
+    {
+        Mips::OpCode code = op->GetOpCode();
+        Location *op1 = Resolve(copyOf, op->GetOp1()), *op2 = Resolve(copyOf, op->GetOp2());
+        if (op1 > op2 && BinaryOp::Swapped(code) != Mips::NumOps)
+        {
+            swap(op1, op2);
+            code = BinaryOp::Swapped(code);
+        }
+        snprintf(key, sizeof(key), "%d %p %p", code, (void*)op1, (void*)op2);
+    }
+    else
+        return "";
+    return key;
+}
+
+int SSAForm::NumberValues(BasicBlock *b, Memory memory, int &generations,
+                          unordered_map<string, Location*> &available,
+                          unordered_map<Location*, Location*> &copyOf)
+{
+    int removed = 0;
+    vector<string> added;
+    if (b->preds.NumElements() > 1)
+        memory.clobbered = ++generations;
+    for (int i = 0; i < b->code.NumElements(); i++)
+    {
+        Instruction *instruction = b->code.Nth(i);
+        Store *store = dynamic_cast<Store*>(instruction);
+        if (dynamic_cast<CallInstr*>(instruction))
+            memory.clobbered = ++generations;
+        if (store)
+        {
+            memory.stored[MemoryClass(store->GetDst(), store->GetOffset(), copyOf)] = ++generations;
+            Location *value = Resolve(copyOf, store->GetSrc());
+            if (IsVersion(value) || IsRenamed(value))
+            {
+                string key = LoadKey(store->GetDst(), store->GetOffset(), memory, copyOf);
+                available[key] = value;
+                added.push_back(key);
+            }
+            continue;
+        }
+        List<Location*> defs = instruction->KillSet();
+        string key = ExpressionKey(instruction, memory, copyOf);
+        if (key.empty() || defs.NumElements() != 1 || !IsVersion(defs.Nth(0)))
+            continue;
+        unordered_map<string, Location*>::iterator it = available.find(key);
+        if (it == available.end())
+        {
+            available[key] = defs.Nth(0);
+            added.push_back(key);
+            continue;
+        }
+        copyOf[defs.Nth(0)] = it->second;
+        instruction->removed = true;
+        removed++;
+    }
+
+    // a child with a single predecessor is entered straight from b
+    for (int c = 0; c < b->children.NumElements(); c++)
+        removed += NumberValues(b->children.Nth(c), memory, generations, available, copyOf);
+    for (int i = 0; i < added.size(); i++)
+        available.erase(added[i]);
+    return removed;
+}
+
+  // Loops sorted innermost first, so code hoisted out of one loop can go
+  // on out of the next
+static bool Inner(Loop *a, Loop *b)
+{
+    return a->body.NumElements() < b->body.NumElements();
+}
+
+  // The single block outside the loop that enters it, or NULL if the
+  // loop has none that only leads into the header
+BasicBlock *SSAForm::Preheader(Loop *loop)
+{
+    BasicBlock *preheader = NULL;
+    for (int p = 0; p < loop->header->preds.NumElements(); p++)
+        if (!loop->contains.Test(loop->header->preds.Nth(p)->id))
+            preheader = preheader ? loop->header : loop->header->preds.Nth(p);
+    if (!preheader || preheader == loop->header || preheader->succs.NumElements() != 1)
+        return NULL;
+    return preheader;
+}
+
+/* Method: HoistInvariants
+ * -----------------------
+ * Loop-invariant code motion into the preheaders insertPreheaders made.
+ * In SSA form an instruction is invariant when each value it reads is
+ * defined outside the loop (or by an instruction already hoisted), or
+ * is a variable's value on entry. Globals and the argument registers
+ * can change anywhere, so nothing reading them moves. Only instructions
+ * that can't trap are hoisted on those grounds alone: running one when
+ * the loop wouldn't have costs a little time but changes nothing.
+ *
+ * A Load can fault, so it only moves if its block dominates every way
+ * out of the loop: then the loop's first trip would have run it anyway.
+ * It also has to read memory no store in the loop can write: array
+ * lengths and vtables always qualify, fields and elements only if the
+ * loop makes no calls and stores nothing of the same alias class.
+ */
+int SSAForm::HoistInvariants()
+{
+    FindDefs();
+    unordered_map<Instruction*, BasicBlock*> blockOf;
+    for (int b = 0; b < graph->NumBlocks(); b++)
+        for (int i = 0; i < graph->Nth(b)->code.NumElements(); i++)
+            blockOf[graph->Nth(b)->code.Nth(i)] = graph->Nth(b);
+
+    vector<Loop*> loops;
+    for (int l = 0; l < graph->Loops()->NumElements(); l++)
+        loops.push_back(graph->Loops()->Nth(l));
+    stable_sort(loops.begin(), loops.end(), Inner);
+
+    unordered_map<Location*, Location*> noCopies;
+    int hoisted = 0;
+    for (int l = 0; l < loops.size(); l++)
+    {
+        Loop *loop = loops[l];
+        BasicBlock *preheader = Preheader(loop);
+        if (!preheader)
+            continue;
+
+        bool calls = false;
+        set<int> stored;
+        vector<BasicBlock*> exits;
+        for (int b = 0; b < loop->body.NumElements(); b++)
+        {
+            BasicBlock *block = loop->body.Nth(b);
+            for (int i = 0; i < block->code.NumElements(); i++)
+            {
+                Instruction *instruction = block->code.Nth(i);
+                Store *store = dynamic_cast<Store*>(instruction);
+                calls |= dynamic_cast<CallInstr*>(instruction) != NULL;
+                if (store)
+                    stored.insert(MemoryClass(store->GetDst(), store->GetOffset(), noCopies));
+            }
+            bool leaves = block->succs.NumElements() == 0;
+            for (int s = 0; s < block->succs.NumElements(); s++)
+                leaves |= !loop->contains.Test(block->succs.Nth(s)->id);
+            if (leaves)
+                exits.push_back(block);
+        }
+
+        bool changed = true;
+        while (changed)
+        {
+            changed = false;
+            for (int b = 0; b < loop->body.NumElements(); b++)
+            {
+                BasicBlock *block = loop->body.Nth(b);
+                for (int i = 0; i < block->code.NumElements(); i++)
+                {
+                    Instruction *instruction = block->code.Nth(i);
+                    BinaryOp *op = dynamic_cast<BinaryOp*>(instruction);
+                    Load *load = dynamic_cast<Load*>(instruction);
+                    List<Location*> defs = instruction->KillSet();
+                    if (defs.NumElements() != 1 || !IsVersion(defs.Nth(0)))
+                        continue;
+                    if (!dynamic_cast<LoadConstant*>(instruction) && !dynamic_cast<LoadLabel*>(instruction)
+                        && !(op && op->GetOpCode() != Mips::Div && op->GetOpCode() != Mips::Mod)
+                        && !load)
+                        continue;
+
+                    bool invariant = true;
+                    List<Location*> uses = instruction->GenSet();
+                    for (int j = 0; j < uses.NumElements() && invariant; j++)
+                    {
+                        Location *use = uses.Nth(j);
+                        if (IsVersion(use))
+                            invariant = !loop->contains.Test(blockOf[defOf[use]]->id);
+                        else
+                            invariant = IsRenamed(use);
+                    }
+                    if (invariant && load)
+                    {
+                        int memoryClass = MemoryClass(load->GetSrc(), load->GetOffset(), noCopies);
+                        invariant = IsImmutable(memoryClass) || (!calls && !stored.count(memoryClass));
+                        for (int e = 0; e < exits.size() && invariant; e++)
+                            invariant = graph->Dominates(block, exits[e]);
+                    }
+                    if (!invariant)
+                        continue;
+
+                    int at = preheader->code.NumElements();
+                    if (dynamic_cast<Goto*>(preheader->code.Nth(at - 1)))
+                        at--;
+                    block->code.RemoveAt(i--);
+                    preheader->code.InsertAt(instruction, at);
+                    blockOf[instruction] = preheader;
+                    hoisted++;
+                    changed = true;
+                }
+            }
+        }
+    }
+    return hoisted;
+}
+
+  // The term for loc, false if it names something that can change
+  // under the function's feet (a global or an argument register)
+bool SSAForm::TermOf(Location *loc, Term &term)
+{
+    if (!IsVersion(loc) && !IsRenamed(loc))
+        return false;
+    unordered_map<Location*, Instruction*>::iterator it = defOf.find(loc);
+    LoadConstant *constant = (it == defOf.end()) ? NULL : dynamic_cast<LoadConstant*>(it->second);
+    term = constant ? Term(NULL, constant->GetValue()) : Term(loc);
+    return true;
+}
+
+  // Whether term has the same value on every trip around loop
+bool SSAForm::IsInvariant(Term term, Loop *loop)
+{
+    return !term.loc || !IsVersion(term.loc) || !loop->contains.Test(defBlock[term.loc]->id);
+}
+
+static bool Same(SSAForm::Term a, SSAForm::Term b)
+{
+    return a.loc == b.loc && (a.loc || a.constant == b.constant);
+}
+
+  // The relations that hold when branch is taken (or isn't)
+void SSAForm::BranchRelations(CondBranch *branch, bool taken, vector<Relation> &relations)
+{
+    IfCompare *cmp = dynamic_cast<IfCompare*>(branch);
+    IfZ *ifz = dynamic_cast<IfZ*>(branch);
+    Mips::OpCode code = Mips::Eq;
+    Term a, b;
+    if (cmp)
+    {
+        code = cmp->GetOpCode();
+        if (!TermOf(cmp->GetOp1(), a) || (cmp->GetOp2() && !TermOf(cmp->GetOp2(), b)))
+            return;
+        if (!cmp->GetOp2())
+            b = Term(NULL, cmp->GetImmediate());
+    }
+    else if (!TermOf(ifz->GetTest(), a))
+        return;
+    switch (taken ? code : BinaryOp::Negated(code))
+    {
+        case Mips::Less:    relations.push_back(Relation(a, b, true)); break;
+        case Mips::Le:      relations.push_back(Relation(a, b, false)); break;
+        case Mips::Gt:      relations.push_back(Relation(b, a, true)); break;
+        case Mips::Ge:      relations.push_back(Relation(b, a, false)); break;
+        case Mips::Eq:      relations.push_back(Relation(a, b, false));
+                            relations.push_back(Relation(b, a, false)); break;
+        default:            break;
+    }
+}
+
+  // The relations that hold along the edge from one block to another
+void SSAForm::EdgeRelations(BasicBlock *from, BasicBlock *to, vector<Relation> &relations)
+{
+    int last = from->code.NumElements() - 1;
+    CondBranch *branch = (last < 0) ? NULL : dynamic_cast<CondBranch*>(from->code.Nth(last));
+    if (!branch)
+        return;
+    BasicBlock *taken = TakenSuccessor(from);
+    BasicBlock *next = from->id + 1 < graph->NumBlocks() ? graph->Nth(from->id + 1) : NULL;
+    if (taken == next)
+        return;
+    if (to == taken)
+        BranchRelations(branch, true, relations);
+    else if (to == next)
+        BranchRelations(branch, false, relations);
+}
+
+  // The relations holding on entry to b. If b can only be entered from
+  // one block (one that calls Halt never goes on) those of the edge
+  // hold, and whatever held in that block; otherwise whatever held in
+  // its immediate dominator. A version names a single value, so once a
+  // relation between two held it still does further on.
+void SSAForm::RelationsAt(BasicBlock *b, vector<Relation> &relations)
+{
+    for (int steps = 0; b && steps < graph->NumBlocks(); steps++)
+    {
+        relations.insert(relations.end(), known[b->id].begin(), known[b->id].end());
+        BasicBlock *from = NULL;
+        for (int p = 0; p < b->preds.NumElements(); p++)
+            if (!halts[b->preds.Nth(p)->id])
+                from = from ? b : b->preds.Nth(p);
+        if (from && from != b)
+        {
+            EdgeRelations(from, b, relations);
+            b = from;
+        }
+        else
+            b = b->idom;
+    }
+}
+
+  // Whether a <= b follows from the terms alone; strict is set if a < b
+  // does too
+static bool NoGreater(SSAForm::Term a, SSAForm::Term b, bool &strict)
+{
+    strict = !a.loc && !b.loc && a.constant < b.constant;
+    if (a.loc || b.loc)
+        return a.loc == b.loc;
+    return a.constant <= b.constant;
+}
+
+  // Whether relations imply query: one of them puts something between
+  // its two sides
+static bool Proves(vector<SSAForm::Relation> &relations, SSAForm::Relation query)
+{
+    bool below, above;
+    if (NoGreater(query.low, query.high, below) && (below || !query.strict))
+        return true;
+    for (int i = 0; i < relations.size(); i++)
+    {
+        SSAForm::Relation &r = relations[i];
+        if (NoGreater(query.low, r.low, below) && NoGreater(r.high, query.high, above)
+            && (!query.strict || r.strict || below || above))
+            return true;
+    }
+    return false;
+}
+
+  // Whether relations imply all of outcome (and there is something to
+  // imply: nothing follows from a branch on "!=" being taken)
+static bool ProvesAll(vector<SSAForm::Relation> &relations, vector<SSAForm::Relation> &outcome)
+{
+    for (int i = 0; i < outcome.size(); i++)
+        if (!Proves(relations, outcome[i]))
+            return false;
+    return !outcome.empty();
+}
+
+/* Method: FindInductions
+ * ----------------------
+ * Bounds the phis of a loop's header. A phi stays below an invariant
+ * bound if the value coming in from the preheader does, and so does
+ * each value coming round a back edge, given what holds at the end of
+ * its latch and along the edge (the loop's exit test, in a rotated
+ * loop). The bounds tried are the ones the first back edge shows. What
+ * the header is about to learn isn't used to show it, which would be
+ * circular. A phi that is strictly below a bound and goes up by one
+ * each trip can't overflow, so it also stays at or above a constant (or
+ * proven non-negative) start. Such a phi, in a loop whose latch is its
+ * only way out and leaves exactly when the bound is reached, is also
+ * recorded as an Induction for HoistableCheck.
+ */
+void SSAForm::FindInductions(Loop *loop)
+{
+    BasicBlock *header = loop->header, *preheader = Preheader(loop);
+    if (!preheader)
+        return;
+    vector<Relation> entry;
+    RelationsAt(preheader, entry);
+    int from = -1;
+    vector<int> latches;
+    vector<vector<Relation> > atLatch(header->preds.NumElements()), test(header->preds.NumElements());
+    for (int p = 0; p < header->preds.NumElements(); p++)
+    {
+        BasicBlock *pred = header->preds.Nth(p);
+        if (!loop->contains.Test(pred->id))
+        {
+            from = p;
+            continue;
+        }
+        latches.push_back(p);
+        RelationsAt(pred, atLatch[p]);
+        EdgeRelations(pred, header, test[p]);
+        atLatch[p].insert(atLatch[p].end(), test[p].begin(), test[p].end());
+    }
+    if (latches.empty())
+        return;
+
+    // whether the single latch is the only block leaving the loop
+    BasicBlock *latch = (latches.size() == 1) ? header->preds.Nth(latches[0]) : NULL;
+    bool latchExits = false, otherExits = false;
+    for (int b = 0; b < loop->body.NumElements(); b++)
+    {
+        BasicBlock *block = loop->body.Nth(b);
+        bool leaves = false;
+        for (int s = 0; s < block->succs.NumElements(); s++)
+            leaves |= !loop->contains.Test(block->succs.Nth(s)->id);
+        if (leaves && !halts[block->id] && block == latch)
+            latchExits = true;
+        else if (leaves && !halts[block->id])
+            otherExits = true;
+    }
+
+    vector<Relation> found;
+    for (int i = 0; i < header->code.NumElements(); i++)
+    {
+        Phi *phi = dynamic_cast<Phi*>(header->code.Nth(i));
+        if (!phi)
+            continue;
+        Term value(phi->GetDst()), start;
+        vector<Term> args(header->preds.NumElements());
+        bool usable = TermOf(phi->GetArg(from), start);
+        for (int l = 0; l < latches.size() && usable; l++)
+            usable = TermOf(phi->GetArg(latches[l]), args[latches[l]]);
+        if (!usable)
+            continue;
+
+        vector<Relation> &candidates = atLatch[latches[0]];
+        Term bound;
+        bool bounded = false, strict = false;
+        for (int c = 0; c < candidates.size() && !bounded; c++)
+        {
+            if (!candidates[c].low.loc || candidates[c].low.loc != args[latches[0]].loc
+                || !IsInvariant(candidates[c].high, loop))
+                continue;
+            for (int s = 1; s >= 0 && !bounded; s--)
+            {
+                bound = candidates[c].high;
+                strict = s;
+                bounded = Proves(entry, Relation(start, bound, strict));
+                for (int l = 0; l < latches.size() && bounded; l++)
+                    bounded = Proves(atLatch[latches[l]], Relation(args[latches[l]], bound, strict));
+            }
+        }
+        if (!bounded)
+            continue;
+        found.push_back(Relation(value, bound, strict));
+
+        bool counts = strict;
+        for (int l = 0; l < latches.size() && counts; l++)
+        {
+            Location *arg = args[latches[l]].loc;
+            BinaryOp *op = (arg && IsVersion(arg)) ? dynamic_cast<BinaryOp*>(defOf[arg]) : NULL;
+            counts = op && op->GetOpCode() == Mips::Add && op->GetOp1() == value.loc
+                && !op->GetOp2() && op->GetImmediate() == 1;
+        }
+        if (counts && start.loc)
+        {
+            counts = Proves(entry, Relation(Term(NULL, 0), start, false));
+            start = Term(NULL, 0);
+        }
+        if (!counts)
+            continue;
+        found.push_back(Relation(start, value, false));
+
+        bool exact = false;
+        for (int r = 0; latch && r < test[latches[0]].size(); r++)
+            exact |= Same(test[latches[0]][r].low, args[latches[0]])
+                && Same(test[latches[0]][r].high, bound) && test[latches[0]][r].strict;
+        if (exact && latchExits && !otherExits && start.constant >= 0)
+        {
+            Induction induction = { loop, preheader, latch, bound };
+            inductions[value.loc] = induction;
+        }
+    }
+    known[header->id].insert(known[header->id].end(), found.begin(), found.end());
+}
+
+  // Whether each trip around loop runs on to the back edge or stops the
+  // program, with nothing on the way anyone could see done: no calls
+  // (but those that halt), no division that could trap and no inner
+  // loop that might never end
+bool SSAForm::IsStraight(Loop *loop)
+{
+    for (int l = 0; l < graph->Loops()->NumElements(); l++)
+    {
+        Loop *other = graph->Loops()->Nth(l);
+        if (other != loop && loop->contains.Test(other->header->id))
+            return false;
+    }
+    for (int b = 0; b < loop->body.NumElements(); b++)
+    {
+        BasicBlock *block = loop->body.Nth(b);
+        for (int i = 0; i < block->code.NumElements() && !halts[block->id]; i++)
+        {
+            BinaryOp *op = dynamic_cast<BinaryOp*>(block->code.Nth(i));
+            if (dynamic_cast<CallInstr*>(block->code.Nth(i))
+                || (op && (op->GetOpCode() == Mips::Div || op->GetOpCode() == Mips::Mod)))
+                return false;
+        }
+    }
+    return true;
+}
+
+  // Whether every trip around the loop of induction that doesn't halt
+  // goes through b, so the latch can't be reached from the header
+  // without it
+bool SSAForm::RunsEveryTrip(BasicBlock *b, Induction &induction)
+{
+    vector<bool> seen(graph->NumBlocks(), false);
+    vector<BasicBlock*> work(1, induction.loop->header);
+    seen[b->id] = true;
+    while (!work.empty())
+    {
+        BasicBlock *block = work.back();
+        work.pop_back();
+        if (seen[block->id] || halts[block->id])
+            continue;
+        if (block == induction.latch)
+            return false;
+        seen[block->id] = true;
+        for (int s = 0; s < block->succs.NumElements(); s++)
+            if (induction.loop->contains.Test(block->succs.Nth(s)->id))
+                work.push_back(block->succs.Nth(s));
+    }
+    return true;
+}
+
+/* Method: HoistableCheck
+ * ----------------------
+ * Whether the bounds check ending b, which jumps past its halt when
+ * ifTaken holds, can be done once in the preheader instead: the index
+ * is a counted loop's induction variable, b runs on every trip that
+ * doesn't halt and the loop is straight. Then the loop fails the check
+ * on some trip exactly when the length is less than the loop's bound,
+ * and as nothing it does before could be seen, failing it up front
+ * looks the same. Returns the block that halts, which the preheader
+ * takes over, if nothing else can reach it: the check against zero in
+ * front must be decided already.
+ */
+BasicBlock *SSAForm::HoistableCheck(BasicBlock *b, vector<Relation> &ifTaken,
+                                    vector<int> &decided)
+{
+    if (ifTaken.size() != 1 || !ifTaken[0].strict || !ifTaken[0].low.loc || !ifTaken[0].high.loc
+        || !inductions.count(ifTaken[0].low.loc))
+        return NULL;
+    Induction &induction = inductions[ifTaken[0].low.loc];
+    if (!induction.loop->contains.Test(b->id) || !RunsEveryTrip(b, induction)
+        || !IsStraight(induction.loop))
+        return NULL;
+    if (!IsInvariant(ifTaken[0].high, induction.loop))
+    {
+        // a length loaded in b itself goes to the preheader with the check
+        Location *length = ifTaken[0].high.loc;
+        Load *load = dynamic_cast<Load*>(defOf[length]);
+        unordered_map<Location*, Location*> noCopies;
+        Term base;
+        if (!load || defBlock[length] != b || !TermOf(load->GetSrc(), base)
+            || !IsInvariant(base, induction.loop)
+            || MemoryClass(load->GetSrc(), load->GetOffset(), noCopies) != ArrayLengths)
+            return NULL;
+    }
+
+    BasicBlock *halt = b->id + 1 < graph->NumBlocks() ? graph->Nth(b->id + 1) : NULL;
+    if (!halt || !halts[halt->id] || TakenSuccessor(b) == halt
+        || !halt->code.NumElements() || !dynamic_cast<Label*>(halt->code.Nth(0)))
+        return NULL;
+    for (int i = 0; i < halt->code.NumElements(); i++)
+        if (dynamic_cast<Phi*>(halt->code.Nth(i)))
+            return NULL;
+    for (int p = 0; p < halt->preds.NumElements(); p++)
+        if (halt->preds.Nth(p) != b && decided[halt->preds.Nth(p)->id] != -1)
+            return NULL;
+    return halt;
+}
+
+/* Method: EliminateChecks
+ * -----------------------
+ * Bounds the induction variables, outermost loops first so an inner
+ * loop can start from what the outer one knows, then decides every
+ * conditional branch it can from the relations holding in its block.
+ * All the branches are looked at before any is changed, since the
+ * relations come from the branches. An index check GenSubscript emits
+ * against zero is decided by the start of the loop variable, the one
+ * against the length by its bound when the loop runs up to the length.
+ *
+ * A check HoistableCheck approves becomes "If bound > length Goto
+ * halt" at the end of the preheader, the code that halts moving there
+ * after the preheader's Goto into the loop (Destroy puts the phi copies
+ * before the check); a second check of the same length in the same loop
+ * shares it.
+ */
+int SSAForm::EliminateChecks()
+{
+    FindDefs();
+    int n = graph->NumBlocks();
+    halts.assign(n, false);
+    known.assign(n, vector<Relation>());
+    inductions.clear();
+    for (int b = 0; b < n; b++)
+        for (int i = 0; i < graph->Nth(b)->code.NumElements(); i++)
+        {
+            LCall *call = dynamic_cast<LCall*>(graph->Nth(b)->code.Nth(i));
+            if (call && !strcmp(call->getLabel(), CodeGenerator::BuiltInLabel(Halt)))
+                halts[b] = true;
+        }
+
+    vector<Loop*> loops;
+    for (int l = 0; l < graph->Loops()->NumElements(); l++)
+        loops.push_back(graph->Loops()->Nth(l));
+    stable_sort(loops.begin(), loops.end(), Inner);
+    for (int l = loops.size() - 1; l >= 0; l--)
+        FindInductions(loops[l]);
+
+    vector<int> decided(n, 0);      // 1 if always taken, -1 if never
+    vector<BasicBlock*> halting(n, NULL);
+    vector<Relation> checked;       // the relation each hoisted check gave
+    for (int b = 0; b < n; b++)
+    {
+        BasicBlock *block = graph->Nth(b);
+        int last = block->code.NumElements() - 1;
+        CondBranch *branch = (last < 0) ? NULL : dynamic_cast<CondBranch*>(block->code.Nth(last));
+        if (!branch || !graph->IsReachable(block))
+            continue;
+        vector<Relation> facts, ifTaken, ifNot;
+        RelationsAt(block, facts);
+        BranchRelations(branch, true, ifTaken);
+        BranchRelations(branch, false, ifNot);
+        if (ProvesAll(facts, ifTaken))
+            decided[b] = 1;
+        else if (ProvesAll(facts, ifNot))
+            decided[b] = -1;
+        else if ((halting[b] = HoistableCheck(block, ifTaken, decided)))
+        {
+            decided[b] = 1;
+            checked.push_back(ifTaken[0]);
+        }
+    }
+
+    int removed = 0;
+    set<string> placed;
+    for (int b = 0, c = 0; b < n; b++)
+    {
+        BasicBlock *block = graph->Nth(b);
+        if (!decided[b])
+            continue;
+        int last = block->code.NumElements() - 1;
+        CondBranch *branch = dynamic_cast<CondBranch*>(block->code.Nth(last));
+        if (decided[b] > 0)
+            Replace(block, last, new Goto(branch->getLabel().c_str()));
+        else
+            block->code.RemoveAt(last);
+        removed++;
+        if (!halting[b])
+            continue;
+
+        Location *length = checked[c].high.loc;
+        Induction &induction = inductions[checked[c++].low.loc];
+        BasicBlock *preheader = induction.preheader, *halt = halting[b];
+        Load *load = IsVersion(length) && induction.loop->contains.Test(defBlock[length]->id)
+            ? dynamic_cast<Load*>(defOf[length]) : NULL;
+        char key[128];          // lengths loaded in the loop are told apart by address
+        snprintf(key, sizeof(key), "%d %p %d %p %d", preheader->id, (void*)induction.bound.loc,
+                 induction.bound.constant, load ? (void*)load->GetSrc() : (void*)length,
+                 load ? load->GetOffset() : 0);
+        if (!placed.insert(key).second)
+            continue;
+        int at = 0;
+        while (at < preheader->code.NumElements() && !dynamic_cast<Goto*>(preheader->code.Nth(at)))
+            at++;
+        if (at == preheader->code.NumElements())
+        {
+            Label *header = dynamic_cast<Label*>(induction.loop->header->code.Nth(0));
+            Assert(header);
+            preheader->code.Append(new Goto(header->getLabel().c_str()));
+        }
+        if (load)
+        {
+            BasicBlock *block = defBlock[length];
+            for (int i = 0; i < block->code.NumElements(); i++)
+                if (block->code.Nth(i) == load)
+                    block->code.RemoveAt(i);
+            preheader->code.InsertAt(load, at++);
+        }
+        string label = dynamic_cast<Label*>(halt->code.Nth(0))->getLabel();
+        if (induction.bound.loc)
+            preheader->code.InsertAt(new IfCompare(Mips::Gt, induction.bound.loc, length, label.c_str()), at);
+        else
+            preheader->code.InsertAt(new IfCompare(Mips::Less, length, induction.bound.constant,
+                                                   label.c_str()), at);
+        preheader->code.AppendAll(halt->code);
+        halt->code.Clear();
+    }
+    return removed;
+}
+
+/* Method: Destroy
+ * ---------------
+ * Sreedhar's method I: each phi gets a fresh temp, every predecessor
+ * copies its argument into the temp just before the branch that ends it
+ * (or at its end when it falls through; in a preheader EliminateChecks
+ * gave checks, before the first of them), and the phi turns into a copy
+ * from the temp. The temp is live only from the end of a predecessor to
+ * the top of the block, so two phis of a block never clobber each
+ * other's arguments even when propagation made their versions overlap.
+ * Coalescing takes out the copies that turn out not to be needed.
+ */
+void SSAForm::Destroy()
+{
+    for (int b = 0; b < graph->NumBlocks(); b++)
+    {
+        BasicBlock *block = graph->Nth(b);
+        for (int i = 0; i < block->code.NumElements(); i++)
+        {
+            Phi *phi = dynamic_cast<Phi*>(block->code.Nth(i));
+            if (!phi)
+                continue;
+            Location *temp = NewVersion(phiVariable[phi]);
+            for (int k = 0; k < phi->NumArgs(); k++)
+            {
+                BasicBlock *pred = block->preds.Nth(k);
+                int at = 0;                             // may have been emptied
+                while (at < pred->code.NumElements() && !dynamic_cast<Goto*>(pred->code.Nth(at))
+                       && !dynamic_cast<CondBranch*>(pred->code.Nth(at)))
+                    at++;
+                pred->code.InsertAt(new Assign(temp, phi->GetArg(k)), at);
+            }
+            Replace(block, i, new Assign(phi->GetDst(), temp));
+        }
+    }
+}
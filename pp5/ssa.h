@@ -0,0 +1,175 @@
+/* File: ssa.h
+ * -----------
+ * The SSAForm class puts the Tac of one function into static single
+ * assignment form over its FlowGraph, runs the optimizations that are
+ * simplest to do on SSA (sparse conditional constant propagation and
+ * copy propagation) and translates the result back out of SSA, ready
+ * for the register allocator. Redundant computations are removed by
+ * value numbering while the function is in SSA form as well, and range
+ * analysis drops the branches (array bounds checks above all) whose
+ * outcome the branches before them already decided.
+ *
+ * Only the function's own stack variables and temps are renamed: each
+ * definition gets a new Location (a "version") with a provisional
+ * offset of its own, so the later passes see them as ordinary temps.
+ * Globals, the precolored argument registers and the incoming stack
+ * parameter slots always refer to memory or a machine register and
+ * keep their single Location.
+ */
+
+#ifndef _H_ssa
+#define _H_ssa
+
+#include "list.h"
+#include "dataflow.h"
+#include <set>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+class Location;
+class Instruction;
+class Phi;
+class CondBranch;
+
+class SSAForm {
+  public:
+         // What constant propagation knows about a version: nothing yet
+         // (Top), that it always holds constant, or that it may vary
+    struct Value {
+        typedef enum { Top, Constant, Bottom } Level;
+        Level level;
+        int constant;
+        Value(Level l = Top, int c = 0) : level(l), constant(c) {}
+    };
+
+         // One side of a relation range analysis knows: a version (or a
+         // variable's value on entry), or a constant when loc is NULL
+    struct Term {
+        Location *loc;
+        int constant;
+        Term(Location *l = NULL, int c = 0) : loc(l), constant(c) {}
+    };
+         // low < high, or low <= high if not strict
+    struct Relation {
+        Term low, high;
+        bool strict;
+        Relation(Term l, Term h, bool s) : low(l), high(h), strict(s) {}
+    };
+
+  private:
+    FlowGraph *graph;
+    std::vector<Location*> *locations;  // numbered Locations, by id
+    std::unordered_map<std::string, Instruction*> *labels;
+    int nextOffset;                     // provisional offset of the next version
+
+    std::unordered_map<Location*, Location*> variableOf;  // version -> variable
+    std::unordered_map<Phi*, Location*> phiVariable;      // phi -> variable
+    std::vector<std::vector<Location*> > stacks;          // by Location id
+    std::unordered_map<Location*, Value> values;          // by version
+    std::set<std::pair<int, int> > executableEdges;       // block ids
+
+    bool IsRenamed(Location *loc);
+    bool IsVersion(Location *loc) { return variableOf.count(loc) > 0; }
+    Location *NewVersion(Location *variable);
+    Location *CurrentVersion(Location *variable);
+    int InsertPhis();
+    void Rename(BasicBlock *b);
+    Value ValueOf(Location *loc);
+    Value Evaluate(Instruction *instr, BasicBlock *b);
+    void RenameUses(std::unordered_map<Location*, Location*> &copyOf);
+
+         // Where value numbering is in the history of memory: each alias
+         // class moves to a new generation when it may have been written
+    struct Memory {
+        int clobbered;                      // fields and elements, by calls and joins
+        std::unordered_map<int, int> stored;    // each class, by its stores
+    };
+    std::unordered_map<Location*, Instruction*> defOf;    // version -> its def
+    void FindDefs();
+    int MemoryClass(Location *base, int offset,
+                    std::unordered_map<Location*, Location*> &copyOf);
+    std::string LoadKey(Location *base, int offset, Memory &memory,
+                        std::unordered_map<Location*, Location*> &copyOf);
+    std::string ExpressionKey(Instruction *instr, Memory &memory,
+                              std::unordered_map<Location*, Location*> &copyOf);
+    int NumberValues(BasicBlock *b, Memory memory, int &generations,
+                     std::unordered_map<std::string, Location*> &available,
+                     std::unordered_map<Location*, Location*> &copyOf);
+    BasicBlock *TakenSuccessor(BasicBlock *b);
+    void Replace(BasicBlock *b, int i, Instruction *with);
+    BasicBlock *Preheader(Loop *loop);
+
+         // A counted loop's variable: a header phi that starts at a
+         // constant or proven non-negative value, goes up by one each
+         // trip and leaves the loop at the latch once it reaches bound
+    struct Induction {
+        Loop *loop;
+        BasicBlock *preheader, *latch;
+        Term bound;
+    };
+    std::unordered_map<Location*, BasicBlock*> defBlock;  // version -> block of its def
+    std::vector<bool> halts;                        // by block id: calls Halt
+    std::vector<std::vector<Relation> > known;      // by block id: hold on entry
+    std::unordered_map<Location*, Induction> inductions;  // by header phi
+    bool TermOf(Location *loc, Term &term);
+    bool IsInvariant(Term term, Loop *loop);
+    void BranchRelations(CondBranch *branch, bool taken, std::vector<Relation> &relations);
+    void EdgeRelations(BasicBlock *from, BasicBlock *to, std::vector<Relation> &relations);
+    void RelationsAt(BasicBlock *b, std::vector<Relation> &relations);
+    void FindInductions(Loop *loop);
+    bool IsStraight(Loop *loop);
+    bool RunsEveryTrip(BasicBlock *b, Induction &induction);
+    BasicBlock *HoistableCheck(BasicBlock *b, std::vector<Relation> &ifTaken,
+                               std::vector<int> &decided);
+
+  public:
+    SSAForm(FlowGraph *graph, std::vector<Location*> *locations,
+            std::unordered_map<std::string, Instruction*> *labels);
+
+         // Inserts phis (pruned by liveness, so a phi is only placed
+         // where its variable is live) and renames every definition.
+         // Needs the gen/kill sets numberLocations attaches. Returns
+         // the number of phis placed.
+    int Build();
+
+         // Sparse conditional constant propagation (Wegman-Zadeck):
+         // folds the values it proves constant into LoadConstants and
+         // immediate operands, and turns branches that can only go one
+         // way into a Goto or nothing. Returns the number of changes.
+    int PropagateConstants();
+
+         // Replaces uses of copies and of phis whose arguments are all
+         // the same value, removing them. Returns the number removed.
+    int PropagateCopies();
+
+         // Dominator-scoped value numbering: drops instructions that
+         // recompute a value already available. A load is also dropped
+         // when the value was loaded or stored there before and alias
+         // analysis shows nothing can have overwritten it. Returns the
+         // number removed.
+    int NumberValues();
+
+         // Moves loop-invariant computations into the loops'
+         // preheaders (which CodeGenerator::insertPreheaders makes).
+         // Returns the number of instructions moved.
+    int HoistInvariants();
+
+         // Range analysis: the relations that hold on entry to a block
+         // are those of the branches it can only be reached through,
+         // and the bounds of the counted loops' induction variables. A
+         // branch whose outcome they decide becomes a Goto or goes. A
+         // bounds check on a counted loop's variable that can't be
+         // proven is replaced by a single one in the preheader, against
+         // the loop's bound, when doing that early can't be observed.
+         // Returns the number of branches removed.
+    int EliminateChecks();
+
+         // Replaces each phi by copies at the end of its predecessors
+         // (through a fresh temp, which keeps it safe when copy
+         // propagation made the phis of a block interfere)
+    void Destroy();
+};
+
+#endif
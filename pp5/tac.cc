@@ -12,43 +12,10 @@
 using namespace std;
 
 Location::Location(Segment s, int o, const char *name) :
-  variableName(strdup(name)), segment(s), offset(o), reference(NULL), reg(Mips::zero) 
+  variableName(strdup(name)), segment(s), offset(o), reference(NULL), id(-1), reg(Mips::zero), spilled(false), precolored(false)
   {
-    edges = new List<Location*>();
   }
 
-void Location::addEdge(Location* edge, bool recall)
-{
-    if (!recall)
-    {
-        for (int i = 0; i < edges->NumElements(); i++)
-        {
-            if (edge == edges->Nth(i))
-                return;
-        }
-        edges->Append(edge); //add edge to current location
-        edge->addEdge(this, true); //two way edge
-    }
-    else
-        edges->Append(edge);
-
-}
-
-int Location::getNumEdges()
-{
-    return edges->NumElements();
-}
-
-Location* Location::getEdge(int n)
-{
-    return edges->Nth(n);
-}
-
-void Location::removeAllEdges()
-{
-    edges->Clear();
-}
-
 string Instruction::TACString()
 {
     string s = printed;
@@ -69,8 +36,15 @@ void Instruction::Emit(Mips *mips) {
 LoadConstant::LoadConstant(Location *d, int v)
   : dst(d), val(v) {
   Assert(dst != NULL);
+  Describe();
+}
+void LoadConstant::Describe() {
   sprintf(printed, "%s = %d", dst->GetName(), val);
 }
+void LoadConstant::RenameDef(Location *from, Location *to) {
+  if (dst == from) dst = to;
+  Describe();
+}
 void LoadConstant::EmitSpecific(Mips *mips) {
   mips->EmitLoadConstant(dst, val);
 }
@@ -80,15 +54,6 @@ List<Location*> LoadConstant::KillSet()
     set.Append(dst);
     return set;
 }
-bool LoadConstant::isDead()
-{
-    for (int i = 0; i < outSet.NumElements(); i++)
-    {
-        if (outSet.Nth(i) == dst)
-            return false;
-    }
-    return true;
-}
 
 LoadStringConstant::LoadStringConstant(Location *d, const char *s)
   : dst(d) {
@@ -96,9 +61,16 @@ LoadStringConstant::LoadStringConstant(Location *d, const char *s)
   const char *quote = (*s == '"') ? "" : "\"";
   str = new char[strlen(s) + 2*strlen(quote) + 1];
   sprintf(str, "%s%s%s", quote, s, quote);
-  quote = (strlen(str) > 50) ? "...\"" : "";
+  Describe();
+}
+void LoadStringConstant::Describe() {
+  const char *quote = (strlen(str) > 50) ? "...\"" : "";
   sprintf(printed, "%s = %.50s%s", dst->GetName(), str, quote);
 }
+void LoadStringConstant::RenameDef(Location *from, Location *to) {
+  if (dst == from) dst = to;
+  Describe();
+}
 void LoadStringConstant::EmitSpecific(Mips *mips) {
   mips->EmitLoadStringConstant(dst, str);
 }
@@ -108,33 +80,48 @@ List<Location*> LoadStringConstant::KillSet()
     set.Append(dst);
     return set;
 }
-bool LoadStringConstant::isDead()
-{
-    for (int i = 0; i < outSet.NumElements(); i++)
-    {
-        if (outSet.Nth(i) == dst)
-            return false;
-    }
-    return true;
-}
      
 
 LoadLabel::LoadLabel(Location *d, const char *l)
   : dst(d), label(strdup(l)) {
   Assert(dst != NULL && label != NULL);
+  Describe();
+}
+void LoadLabel::Describe() {
   sprintf(printed, "%s = %s", dst->GetName(), label);
 }
+void LoadLabel::RenameDef(Location *from, Location *to) {
+  if (dst == from) dst = to;
+  Describe();
+}
 void LoadLabel::EmitSpecific(Mips *mips) {
   mips->EmitLoadLabel(dst, label);
 }
+List<Location*> LoadLabel::KillSet()
+{
+    List<Location*> set;
+    set.Append(dst);
+    return set;
+}
 
 
 
 Assign::Assign(Location *d, Location *s)
   : dst(d), src(s) {
   Assert(dst != NULL && src != NULL);
+  Describe();
+}
+void Assign::Describe() {
   sprintf(printed, "%s = %s", dst->GetName(), src->GetName());
 }
+void Assign::RenameUse(Location *from, Location *to) {
+  if (src == from) src = to;
+  Describe();
+}
+void Assign::RenameDef(Location *from, Location *to) {
+  if (dst == from) dst = to;
+  Describe();
+}
 void Assign::EmitSpecific(Mips *mips) {
   mips->EmitCopy(dst, src);
 }
@@ -150,24 +137,26 @@ List<Location*> Assign::GenSet()
     set.Append(src);
     return set;
 }
-bool Assign::isDead()
-{
-    for (int i = 0; i < outSet.NumElements(); i++)
-    {
-        if (outSet.Nth(i) == dst)
-            return false;
-    }
-    return true;
-}
 
 Load::Load(Location *d, Location *s, int off)
   : dst(d), src(s), offset(off) {
   Assert(dst != NULL && src != NULL);
+  Describe();
+}
+void Load::Describe() {
   if (offset) 
     sprintf(printed, "%s = *(%s + %d)", dst->GetName(), src->GetName(), offset);
   else
     sprintf(printed, "%s = *(%s)", dst->GetName(), src->GetName());
 }
+void Load::RenameUse(Location *from, Location *to) {
+  if (src == from) src = to;
+  Describe();
+}
+void Load::RenameDef(Location *from, Location *to) {
+  if (dst == from) dst = to;
+  Describe();
+}
 void Load::EmitSpecific(Mips *mips) {
   mips->EmitLoad(dst, src, offset);
 }
@@ -188,11 +177,19 @@ List<Location*> Load::KillSet()
 Store::Store(Location *d, Location *s, int off)
   : dst(d), src(s), offset(off) {
   Assert(dst != NULL && src != NULL);
+  Describe();
+}
+void Store::Describe() {
   if (offset)
     sprintf(printed, "*(%s + %d) = %s", dst->GetName(), offset, src->GetName());
   else
     sprintf(printed, "*(%s) = %s", dst->GetName(), src->GetName());
 }
+void Store::RenameUse(Location *from, Location *to) {
+  if (dst == from) dst = to;
+  if (src == from) src = to;
+  Describe();
+}
 void Store::EmitSpecific(Mips *mips) {
   mips->EmitStore(dst, src, offset);
 }
@@ -204,24 +201,83 @@ List<Location*> Store::GenSet()
     return set;
 }
  
-const char * const BinaryOp::opName[Mips::NumOps]  = {"+", "-", "*", "/", "%", "==", "<", "&&", "||"};;
+const char * const BinaryOp::opName[Mips::NumOps]  = {"+", "-", "*", "/", "%", "==", "!=",
+    "<", "<=", ">", ">=", "&&", "||", "<<", "-", "!"};
+
+Mips::OpCode BinaryOp::Negated(Mips::OpCode code) {
+  switch (code) {
+    case Mips::Eq:      return Mips::Ne;
+    case Mips::Ne:      return Mips::Eq;
+    case Mips::Less:    return Mips::Ge;
+    case Mips::Ge:      return Mips::Less;
+    case Mips::Le:      return Mips::Gt;
+    case Mips::Gt:      return Mips::Le;
+    default:            return Mips::NumOps;
+  }
+}
+
+Mips::OpCode BinaryOp::Swapped(Mips::OpCode code) {
+  switch (code) {
+    case Mips::Add: case Mips::Mul: case Mips::Eq: case Mips::Ne:
+    case Mips::And: case Mips::Or:
+      return code;
+    case Mips::Less:    return Mips::Gt;
+    case Mips::Gt:      return Mips::Less;
+    case Mips::Le:      return Mips::Ge;
+    case Mips::Ge:      return Mips::Le;
+    default:            return Mips::NumOps;
+  }
+}
 
-Mips::OpCode BinaryOp::OpCodeForName(const char *name) {
+Mips::OpCode BinaryOp::OpCodeForName(const char *name, bool unary) {
   for (int i = 0; i < Mips::NumOps; i++) 
-    if (opName[i] && !strcmp(opName[i], name))
+    if (opName[i] && !strcmp(opName[i], name) && IsUnary((Mips::OpCode)i) == unary)
 	return (Mips::OpCode)i;
   Failure("Unrecognized Tac operator: '%s'\n", name);
   return Mips::Add; // can't get here, but compiler doesn't know that
 }
 
 BinaryOp::BinaryOp(Mips::OpCode c, Location *d, Location *o1, Location *o2)
-  : code(c), dst(d), op1(o1), op2(o2) {
+  : code(c), dst(d), op1(o1), op2(o2), immediate(0) {
   Assert(dst != NULL && op1 != NULL && op2 != NULL);
-  Assert(code >= 0 && code < Mips::NumOps);
-  sprintf(printed, "%s = %s %s %s", dst->GetName(), op1->GetName(), opName[code], op2->GetName());
+  Assert(code >= 0 && code < Mips::NumOps && !IsUnary(code));
+  Describe();
+}
+BinaryOp::BinaryOp(Mips::OpCode c, Location *d, Location *o1, int imm)
+  : code(c), dst(d), op1(o1), op2(NULL), immediate(imm) {
+  Assert(dst != NULL && op1 != NULL);
+  Assert(code >= 0 && code < Mips::NumOps && Mips::HasImmediateForm(code, imm));
+  Describe();
+}
+BinaryOp::BinaryOp(Mips::OpCode c, Location *d, Location *o)
+  : code(c), dst(d), op1(o), op2(NULL), immediate(0) {
+  Assert(dst != NULL && op1 != NULL && IsUnary(code));
+  Describe();
+}
+void BinaryOp::Describe() {
+  if (IsUnary(code))
+    sprintf(printed, "%s = %s %s", dst->GetName(), opName[code], op1->GetName());
+  else if (op2)
+    sprintf(printed, "%s = %s %s %s", dst->GetName(), op1->GetName(), opName[code], op2->GetName());
+  else
+    sprintf(printed, "%s = %s %s %d", dst->GetName(), op1->GetName(), opName[code], immediate);
+}
+void BinaryOp::RenameUse(Location *from, Location *to) {
+  if (op1 == from) op1 = to;
+  if (op2 == from) op2 = to;
+  Describe();
+}
+void BinaryOp::RenameDef(Location *from, Location *to) {
+  if (dst == from) dst = to;
+  Describe();
 }
 void BinaryOp::EmitSpecific(Mips *mips) {	  
-  mips->EmitBinaryOp(code, dst, op1, op2);
+  if (IsUnary(code))
+    mips->EmitUnaryOp(code, dst, op1);
+  else if (op2)
+    mips->EmitBinaryOp(code, dst, op1, op2);
+  else
+    mips->EmitBinaryOp(code, dst, op1, immediate);
 }
 List<Location*> BinaryOp::KillSet()
 {
@@ -233,18 +289,10 @@ List<Location*> BinaryOp::GenSet()
 {
     List<Location*> set;
     set.Append(op1);
-    set.Append(op2);
+    if (op2)
+        set.Append(op2);
     return set;
 }
-bool BinaryOp::isDead()
-{
-    for (int i = 0; i < outSet.NumElements(); i++)
-    {
-        if (outSet.Nth(i) == dst)
-            return false;
-    }
-    return true;
-}
 
 Label::Label(const char *l) : label(strdup(l)) {
   Assert(label != NULL);
@@ -256,6 +304,11 @@ void Label::Print() {
 void Label::EmitSpecific(Mips *mips) {
   mips->EmitLabel(label);
 }
+string Label::getLabel()
+{
+    string s = label;
+    return s;
+}
 
 
  
@@ -271,20 +324,43 @@ string Goto::getLabel()
     string s = label;
     return s;
 }
+void Goto::SetLabel(const char *l) {
+  label = strdup(l);
+  sprintf(printed, "Goto %s", label);
+}
+
+
+CondBranch::CondBranch(const char *l) : label(strdup(l)) {
+  Assert(label != NULL);
+}
+string CondBranch::getLabel()
+{
+    string s = label;
+    return s;
+}
+void CondBranch::SetLabel(const char *l) {
+  label = strdup(l);
+  Describe();
+}
 
 
 IfZ::IfZ(Location *te, const char *l)
-   : test(te), label(strdup(l)) {
-  Assert(test != NULL && label != NULL);
+   : CondBranch(l), test(te) {
+  Assert(test != NULL);
+  Describe();
+}
+void IfZ::Describe() {
   sprintf(printed, "IfZ %s Goto %s", test->GetName(), label);
 }
+void IfZ::RenameUse(Location *from, Location *to) {
+  if (test == from) test = to;
+  Describe();
+}
 void IfZ::EmitSpecific(Mips *mips) {	  
   mips->EmitIfZ(test, label);
 }
-string IfZ::getLabel()
-{
-    string s = label;
-    return s;
+CondBranch *IfZ::Negated(const char *l) {
+  return new IfCompare(Mips::Ne, test, 0, l);
 }
 List<Location*> IfZ::GenSet()
 {
@@ -293,64 +369,86 @@ List<Location*> IfZ::GenSet()
     return set;
 }
 
+
+IfCompare::IfCompare(Mips::OpCode c, Location *o1, Location *o2, const char *l)
+   : CondBranch(l), code(c), op1(o1), op2(o2), immediate(0) {
+  Assert(op1 != NULL && op2 != NULL);
+  Describe();
+}
+IfCompare::IfCompare(Mips::OpCode c, Location *o1, int imm, const char *l)
+   : CondBranch(l), code(c), op1(o1), op2(NULL), immediate(imm) {
+  Assert(op1 != NULL);
+  Describe();
+}
+void IfCompare::Describe() {
+  if (op2)
+    sprintf(printed, "If %s %s %s Goto %s", op1->GetName(), BinaryOp::opName[code],
+            op2->GetName(), label);
+  else
+    sprintf(printed, "If %s %s %d Goto %s", op1->GetName(), BinaryOp::opName[code],
+            immediate, label);
+}
+CondBranch *IfCompare::Negated(const char *l) {
+  if (op2)
+    return new IfCompare(BinaryOp::Negated(code), op1, op2, l);
+  return new IfCompare(BinaryOp::Negated(code), op1, immediate, l);
+}
+void IfCompare::RenameUse(Location *from, Location *to) {
+  if (op1 == from) op1 = to;
+  if (op2 == from) op2 = to;
+  Describe();
+}
+void IfCompare::EmitSpecific(Mips *mips) {
+  if (op2)
+    mips->EmitBranch(code, op1, op2, label);
+  else
+    mips->EmitBranch(code, op1, immediate, label);
+}
+List<Location*> IfCompare::GenSet()
+{
+    List<Location*> set;
+    set.Append(op1);
+    if (op2)
+        set.Append(op2);
+    return set;
+}
+
 BeginFunc::BeginFunc() {
   sprintf(printed,"BeginFunc (unassigned)");
   frameSize = -555; // used as sentinel to recognized unassigned value
+  outgoingSize = 0;
+  calleeSaved = 0;
+  makesCalls = readsParamSlots = true;
+}
+void BeginFunc::Describe() {
+  sprintf(printed,"BeginFunc %d", frameSize + outgoingSize);
 }
 void BeginFunc::SetFrameSize(int numBytesForAllLocalsAndTemps) {
   frameSize = numBytesForAllLocalsAndTemps; 
-  sprintf(printed,"BeginFunc %d", frameSize);
+  Describe();
 }
-void BeginFunc::EmitSpecific(Mips *mips) {
-  mips->EmitBeginFunction(frameSize);
-  /* pp5: need to load all parameters to the allocated registers.
-   */
-  Location* fp = new Location(fpRelative, -800-frameSize, "framePointer");
-  fp->SetRegister(Mips::Register(30));
-
-  if (isMethod)
-  {
-    for (int i = 0; i < inSet.NumElements(); i++)
-    {
-      if (!strcmp(inSet.Nth(i)->GetName(), "this"))
-      {
-        mips->EmitLoad(inSet.Nth(i), fp, 4);
-      }
-    }
-  }
-
-  for (int i = 0; i < parameters.NumElements(); i++)
-  {
-    mips->EmitLoad(parameters.Nth(i), fp, i*4 + 4 + 4*isMethod);
-    // cout << parameters.Nth(i)->GetName() << endl;
-  }
-//   Mips::Register reg;
-//   int numLoaded = 0;
-//   Mips::Register lastReg;
-//   while (numLoaded != inSet.NumElements()) //uses the fact that the first parameter is (always?) the highest register
-//   {
-//     reg = Mips::Register(0);
-//     Location* param;
-//     for (int i = 0; i < inSet.NumElements(); i++)
-//     {
-//       if (inSet.Nth(i)->GetRegister() > reg && inSet.Nth(i)->GetRegister() < lastReg)
-//       {
-//         reg = inSet.Nth(i)->GetRegister();
-//         param = inSet.Nth(i);
-//       }
-//     }
-//     mips->EmitLoad(param, loc, numLoaded*4 + 12 + frameSize);
-//     numLoaded++;
-//     lastReg = reg;
-//   }
-}
-void BeginFunc::addParameter(Location* param)
-{
-  parameters.Append(param);
+void BeginFunc::SetOutgoingSize(int numBytesForArguments) {
+  Assert(numBytesForArguments >= 0);
+  outgoingSize = numBytesForArguments;
+  Describe();
 }
-void BeginFunc::checkMethod(FnDecl* fn)
-{
-  isMethod = fn->IsMethodDecl();
+void BeginFunc::SetCalleeSaved(unsigned int registerMask) {
+  Assert(frameSize >= 0);
+  SetFrameSize(frameSize + 4*(__builtin_popcount(registerMask) - __builtin_popcount(calleeSaved)));
+  calleeSaved = registerMask;
+}
+void BeginFunc::SetFrameUse(bool calls, bool paramSlots) {
+  makesCalls = calls;
+  readsParamSlots = paramSlots;
+}
+void BeginFunc::EmitSpecific(Mips *mips) {
+  Mips::FrameKind kind = Mips::FullFrame;
+  // with the frame pointer omitted the parameters are found from $sp
+  // even when the function has no frame
+  bool needsFp = readsParamSlots && !IsOptionOn("omit-frame-pointer");
+  if (!makesCalls)
+    kind = frameSize + outgoingSize == 0 && !needsFp ? Mips::NoFrame : Mips::LeafFrame;
+  mips->EmitBeginFunction(frameSize, calleeSaved, outgoingSize, kind);
 }
 
 
@@ -364,8 +462,15 @@ void EndFunc::EmitSpecific(Mips *mips) {
 
  
 Return::Return(Location *v) : val(v) {
+  Describe();
+}
+void Return::Describe() {
   sprintf(printed, "Return %s", val? val->GetName() : "");
 }
+void Return::RenameUse(Location *from, Location *to) {
+  if (val == from) val = to;
+  Describe();
+}
 void Return::EmitSpecific(Mips *mips) {	  
   mips->EmitReturn(val);
 }
@@ -380,13 +485,20 @@ List<Location*> Return::GenSet()
 }
 
 
-PushParam::PushParam(Location *p)
-  :  param(p) {
-  Assert(param != NULL);
-  sprintf(printed, "PushParam %s", param->GetName());
+PushParam::PushParam(Location *p, int o)
+  :  param(p), offset(o) {
+  Assert(param != NULL && offset > 0);
+  Describe();
+}
+void PushParam::Describe() {
+  sprintf(printed, "PushParam %s (%d)", param->GetName(), offset);
+}
+void PushParam::RenameUse(Location *from, Location *to) {
+  if (param == from) param = to;
+  Describe();
 }
 void PushParam::EmitSpecific(Mips *mips) {
-  mips->EmitParam(param);
+  mips->EmitParam(param, offset);
 } 
 List<Location*> PushParam::GenSet()
 {
@@ -395,86 +507,149 @@ List<Location*> PushParam::GenSet()
     return set;
 }
 
-PopParams::PopParams(int nb)
-  :  numBytes(nb) {
-  sprintf(printed, "PopParams %d", numBytes);
-}
-void PopParams::EmitSpecific(Mips *mips) {
-  mips->EmitPopParams(numBytes);
-} 
 
 
 
 
-LCall::LCall(const char *l, Location *d)
-  :  label(strdup(l)), dst(d) {
-  sprintf(printed, "%s%sLCall %s", dst? dst->GetName(): "", dst?" = ":"", label);
+void CallInstr::SetArgRegisters(List<Location*> *regs, int numUsed) {
+  Assert(numUsed <= regs->NumElements());
+  argRegs = *regs;
+  numArgRegs = numUsed;
 }
-void LCall::EmitSpecific(Mips *mips) {
-  /* pp5: need to save registers before a function call
-   * and restore them back after the call.
-   */
-    for (int i = 0; i < inSet.NumElements(); i++)
-    {
-        mips->SaveCaller(inSet.Nth(i));
-    }
-
-    mips->EmitLCall(dst, label);
-
-    for (int i = 0; i < inSet.NumElements(); i++)
-    {
-        mips->RestoreCaller(inSet.Nth(i));
-    }
+void CallInstr::RenameDef(Location *from, Location *to) {
+  if (dst == from) dst = to;
+  Describe();
+}
+List<Location*> CallInstr::GenSet()
+{
+    List<Location*> set;
+    for (int i = 0; i < numArgRegs; i++)
+        set.Append(argRegs.Nth(i));
+    return set;
 }
-List<Location*> LCall::KillSet()
+List<Location*> CallInstr::KillSet()
 {
-    List<Location*> set;    
+    List<Location*> set = argRegs;   // the callee is free to reuse them
     if (dst)
     {
         set.Append(dst);
     }
     return set;
 }
-
-ACall::ACall(Location *ma, Location *d)
-  : dst(d), methodAddr(ma) {
-  Assert(methodAddr != NULL);
-  sprintf(printed, "%s%sACall %s", dst? dst->GetName(): "", dst?" = ":"",
-	    methodAddr->GetName());
+  // The locations that have to survive the call: live after it, not
+  // the result, and in a register the callee may clobber. Coalesced
+  // locations share a register, so only the first location seen in
+  // each register is kept.
+List<Location*> CallInstr::LiveAcrossCall()
+{
+    List<Location*> live;
+    unsigned int seen = 0;
+    for (int i = 0; i < outSet.NumElements(); i++)
+    {
+        Location *loc = outSet.Nth(i);
+        if (loc == dst || (seen & (1u << loc->GetRegister())))
+            continue;
+        if (loc->GetRegister() && !(clobbers & (1u << loc->GetRegister())))
+            continue;
+        if (loc->GetRegister())
+            seen |= 1u << loc->GetRegister();
+        live.Append(loc);
+    }
+    return live;
 }
-void ACall::EmitSpecific(Mips *mips) {
+void CallInstr::EmitSpecific(Mips *mips) {
   /* pp5: need to save registers before a function call
    * and restore them back after the call.
    */
-    for (int i = 0; i < outSet.NumElements(); i++)
+    List<Location*> live = LiveAcrossCall();
+    for (int i = 0; i < live.NumElements(); i++)
     {
-        if (outSet.Nth(i) != dst)
-            mips->SaveCaller(outSet.Nth(i));
+        mips->SaveCaller(live.Nth(i));
     }
 
-    mips->EmitACall(dst, methodAddr);
+    EmitCall(mips);
 
-    for (int i = 0; i < outSet.NumElements(); i++)
+    for (int i = 0; i < live.NumElements(); i++)
     {
-        if (outSet.Nth(i) != dst)
-            mips->RestoreCaller(outSet.Nth(i));
+        mips->RestoreCaller(live.Nth(i));
     }
-} 
+}
+
+
+LCall::LCall(const char *l, Location *d)
+  :  CallInstr(d), label(strdup(l)) {
+  Describe();
+}
+void LCall::Describe() {
+  sprintf(printed, "%s%sLCall %s", dst? dst->GetName(): "", dst?" = ":"", label);
+}
+void LCall::EmitCall(Mips *mips) {
+  mips->EmitLCall(dst, label);
+}
+
+ACall::ACall(Location *ma, Location *d)
+  : CallInstr(d), methodAddr(ma) {
+  Assert(methodAddr != NULL);
+  Describe();
+}
+void ACall::Describe() {
+  sprintf(printed, "%s%sACall %s", dst? dst->GetName(): "", dst?" = ":"",
+	    methodAddr->GetName());
+}
+void ACall::RenameUse(Location *from, Location *to) {
+  if (methodAddr == from) methodAddr = to;
+  Describe();
+}
+void ACall::EmitCall(Mips *mips) {
+  mips->EmitACall(dst, methodAddr);
+}
 List<Location*> ACall::GenSet()
 {
-    List<Location*> set;
+    List<Location*> set = CallInstr::GenSet();
     set.Append(methodAddr);
     return set;
 }
-List<Location*> ACall::KillSet()
+
+
+Phi::Phi(Location *d, int numPreds) : dst(d) {
+  Assert(dst != NULL);
+  for (int i = 0; i < numPreds; i++)
+    args.Append(d);
+  Describe();
+}
+void Phi::Describe() {
+  int n = snprintf(printed, sizeof(printed), "%s = phi(", dst->GetName());
+  for (int i = 0; i < args.NumElements() && n < sizeof(printed); i++)
+    n += snprintf(printed + n, sizeof(printed) - n, "%s%s", i ? ", " : "", args.Nth(i)->GetName());
+  if (n < sizeof(printed))
+    snprintf(printed + n, sizeof(printed) - n, ")");
+}
+void Phi::SetArg(int i, Location *arg) {
+  args.RemoveAt(i);
+  args.InsertAt(arg, i);
+  Describe();
+}
+void Phi::EmitSpecific(Mips *mips) {
+  Failure("Phi for %s left in the code", dst->GetName());
+}
+void Phi::RenameUse(Location *from, Location *to) {
+  for (int i = 0; i < args.NumElements(); i++)
+    if (args.Nth(i) == from) SetArg(i, to);
+}
+void Phi::RenameDef(Location *from, Location *to) {
+  if (dst == from) dst = to;
+  Describe();
+}
+List<Location*> Phi::KillSet()
 {
     List<Location*> set;
-    if (dst)
-    {
-        set.Append(dst);
-    }
+    set.Append(dst);
     return set;
 }
+List<Location*> Phi::GenSet()
+{
+    return args;
+}
 
 
 VTable::VTable(const char *l, List<const char *> *m)
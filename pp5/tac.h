@@ -25,6 +25,7 @@
 
 #include "list.h" // for VTable
 #include "mips.h"
+#include "bitvector.h"
 #include "ast_decl.h"
 
     // A Location object is used to identify the operands to the
@@ -47,32 +48,49 @@ class Location
     int offset;
     Location *reference;
     int refOffset;
-    List<Location*>* edges;
+
+    // Dense number given to the location by the dataflow passes of
+    // the function currently being analyzed (-1 until numbered).
+    int id;
     
     // The register allocated to this location.
     // A "zero" indicates that no register has been allocated.
     Mips::Register reg;
+
+    // Set when the allocator spills the location: from then on it
+    // lives in its stack slot and only short-lived copies of it are
+    // given registers.
+    bool spilled;
+
+    // Set for the locations standing for a fixed machine register
+    // (the argument registers): the allocator never changes reg.
+    bool precolored;
 	  
   public:
     Location(Segment seg, int offset, const char *name);
     Location(Location *base, int refOff) :
     variableName(base->variableName), segment(base->segment),
-	offset(base->offset), reference(base), refOffset(refOff) { edges = new List<Location*>();}
+	offset(base->offset), reference(base), refOffset(refOff), id(-1), reg(Mips::zero), spilled(false), precolored(false) {}
  
     const char *GetName()           { return variableName; }
     Segment GetSegment()            { return segment; }
     int GetOffset()                 { return offset; }
+    void SetOffset(int o)           { offset = o; }
     bool IsReference()              { return reference != NULL; }
     Location *GetReference()        { return reference; }
     int GetRefOffset()              { return refOffset; }
 
-    void addEdge(Location* edge, bool recall = false);
-    int getNumEdges();
-    Location* getEdge(int n);
-    void removeAllEdges();
+    void SetId(int i)                     { id = i; }
+    int GetId()                           { return id; }
     
     void SetRegister(Mips::Register r)    { reg = r; }
     Mips::Register GetRegister()          { return reg; }
+
+    void SetSpilled()                     { spilled = true; }
+    bool IsSpilled()                      { return spilled; }
+
+    void SetPrecolored(Mips::Register r)  { reg = r; precolored = true; }
+    bool IsPrecolored()                   { return precolored; }
 };
  
 
@@ -83,15 +101,16 @@ class Location
 class Instruction {
     protected:
         char printed[128];
-        List<Instruction*> directedEdges;
 
     public:
         List<Location*> inSet;
         List<Location*> outSet;
 
-        void addEdge(Instruction* instruction) { directedEdges.Append(instruction); }
-        int getNumEdges() { return directedEdges.NumElements(); }
-        Instruction* getEdge(int n) { return directedEdges.Nth(n); }
+        // Bit vector forms of the sets above, indexed by Location id.
+        // gen/kill are filled in once per function, liveIn/liveOut are
+        // what livenessAnalysis iterates on.
+        BitVector liveIn, liveOut, gen, kill;
+
         string TACString();
 
 
@@ -101,7 +120,18 @@ class Instruction {
   	    virtual void Emit(Mips *mips);
         virtual List<Location*> KillSet() { List<Location*> empty; return empty; }
         virtual List<Location*> GenSet() { List<Location*> empty; return empty; }
-        virtual bool isDead() { return false; }
+        // True if the only effect is writing the destination, so the
+        // instruction can go when that value is never used
+        virtual bool isPure() { return false; }
+        // Replace the operand from with to wherever the instruction
+        // reads it (RenameUse) or writes it (RenameDef)
+        virtual void RenameUse(Location *from, Location *to) {}
+        virtual void RenameDef(Location *from, Location *to) {}
+
+        // Tombstone set by dead code elimination once the instruction
+        // has been dropped from the function
+        bool removed;
+        Instruction() : removed(false) {}
 };
 
   
@@ -109,24 +139,27 @@ class Instruction {
   // for convenience, the instruction classes are listed here.
   // the interfaces for the classes follows below
   
-  class LoadConstant;//Has Kill isDead
-  class LoadStringConstant;//Has Kill isDead
-  class LoadLabel;
-  class Assign; //Has Gen and Kill isDead
-  class Load; //Has Gen and Kill
+  class LoadConstant;//Has Kill isPure
+  class LoadStringConstant;//Has Kill isPure
+  class LoadLabel;//Has Kill isPure
+  class Assign; //Has Gen and Kill isPure
+  class Load; //Has Gen and Kill isPure
   class Store; //Has Gen
-  class BinaryOp; //Has Gen and Kill isDead
+  class BinaryOp; //Has Gen and Kill isPure
   class Label;
   class Goto;
+  class CondBranch;
   class IfZ; //Has Gen
+  class IfCompare; //Has Gen
   class BeginFunc;
   class EndFunc;
   class Return; //Has Gen
   class PushParam; //Has Gen
-  class RemoveParams;
-  class LCall; //Has Kill isDead
-  class ACall; //Has Kill isDead
+  class CallInstr; //Has Gen and Kill
+  class LCall; //Has Gen and Kill
+  class ACall; //Has Gen and Kill
   class VTable;
+  class Phi; //Has Gen and Kill isPure
 
 
 
@@ -134,57 +167,84 @@ class Instruction {
 class LoadConstant: public Instruction {
     Location *dst;
     int val;
+    void Describe();
   public:
     LoadConstant(Location *dst, int val);
+    Location *GetDst()              { return dst; }
+    int GetValue()                  { return val; }
     void EmitSpecific(Mips *mips);
+    void RenameDef(Location *from, Location *to);
     List<Location*> KillSet();
-    bool isDead();
+    bool isPure() { return true; }
 };
 
 class LoadStringConstant: public Instruction {
     Location *dst;
     char *str;
+    void Describe();
   public:
     LoadStringConstant(Location *dst, const char *s);
     void EmitSpecific(Mips *mips);
+    void RenameDef(Location *from, Location *to);
     List<Location*> KillSet();
-    bool isDead();
+    bool isPure() { return true; }
 };
     
 class LoadLabel: public Instruction {
     Location *dst;
     const char *label;
+    void Describe();
   public:
     LoadLabel(Location *dst, const char *label);
     void EmitSpecific(Mips *mips);
+    void RenameDef(Location *from, Location *to);
+    List<Location*> KillSet();
+    bool isPure() { return true; }
 };
 
 class Assign: public Instruction {
     Location *dst, *src;
+    void Describe();
   public:
     Assign(Location *dst, Location *src);
+    Location *GetDst()              { return dst; }
+    Location *GetSrc()              { return src; }
     void EmitSpecific(Mips *mips);
+    void RenameUse(Location *from, Location *to);
+    void RenameDef(Location *from, Location *to);
     List<Location*> KillSet();
     List<Location*> GenSet();
-    bool isDead();
+    bool isPure() { return true; }
 };
 
 class Load: public Instruction {
     Location *dst, *src;
     int offset;
+    void Describe();
   public:
     Load(Location *dst, Location *src, int offset = 0);
+    Location *GetDst()              { return dst; }
+    Location *GetSrc()              { return src; }
+    int GetOffset()                 { return offset; }
     void EmitSpecific(Mips *mips);
+    void RenameUse(Location *from, Location *to);
+    void RenameDef(Location *from, Location *to);
     List<Location*> KillSet();
     List<Location*> GenSet();
+    bool isPure() { return true; }
 };
 
 class Store: public Instruction {
     Location *dst, *src;
     int offset;
+    void Describe();
   public:
     Store(Location *d, Location *s, int offset = 0);
+    Location *GetDst()              { return dst; }
+    Location *GetSrc()              { return src; }
+    int GetOffset()                 { return offset; }
     void EmitSpecific(Mips *mips);
+    void RenameUse(Location *from, Location *to);
     List<Location*> GenSet();
 };
 
@@ -192,17 +252,35 @@ class BinaryOp: public Instruction {
 
   public:
     static const char * const opName[Mips::NumOps];
-    static Mips::OpCode OpCodeForName(const char *name);
+    static Mips::OpCode OpCodeForName(const char *name, bool unary = false);
+    static bool IsUnary(Mips::OpCode c) { return c == Mips::Neg || c == Mips::Not; }
+    // the comparison that holds exactly when c doesn't, or NumOps if c
+    // isn't a comparison
+    static Mips::OpCode Negated(Mips::OpCode c);
+    // the op giving the same result with the operands swapped, or
+    // NumOps if there's none
+    static Mips::OpCode Swapped(Mips::OpCode c);
     
   protected:
     Mips::OpCode code;
-    Location *dst, *op1, *op2;
+    Location *dst, *op1, *op2;      // op2 is NULL for a unary op or
+    int immediate;                  // when it's the constant immediate
+    void Describe();
   public:
     BinaryOp(Mips::OpCode c, Location *dst, Location *op1, Location *op2);
+    BinaryOp(Mips::OpCode c, Location *dst, Location *op1, int immediate);
+    BinaryOp(Mips::OpCode c, Location *dst, Location *op);
+    Mips::OpCode GetOpCode()        { return code; }
+    Location *GetDst()              { return dst; }
+    Location *GetOp1()              { return op1; }
+    Location *GetOp2()              { return op2; }
+    int GetImmediate()              { return immediate; }
     void EmitSpecific(Mips *mips);
+    void RenameUse(Location *from, Location *to);
+    void RenameDef(Location *from, Location *to);
     List<Location*> KillSet();
     List<Location*> GenSet();
-    bool isDead();
+    bool isPure() { return true; }
 };
 
 class Label: public Instruction {
@@ -210,6 +288,7 @@ class Label: public Instruction {
   public:
     Label(const char *label);
     void Print();
+    string getLabel();
     void EmitSpecific(Mips *mips);
 };
 
@@ -219,29 +298,78 @@ class Goto: public Instruction {
     Goto(const char *label);
     void EmitSpecific(Mips *mips);
     string getLabel();
+    void SetLabel(const char *label);
 };
 
-class IfZ: public Instruction {
-    Location *test;
+  // A conditional jump to label, falling through to the next
+  // instruction when it isn't taken
+class CondBranch: public Instruction {
+  protected:
     const char *label;
+    virtual void Describe() = 0;
+  public:
+    CondBranch(const char *label);
+    string getLabel();
+    void SetLabel(const char *label);
+    // a new branch to label taken exactly when this one isn't
+    virtual CondBranch *Negated(const char *label) = 0;
+};
+
+class IfZ: public CondBranch {
+    Location *test;
+    void Describe();
   public:
     IfZ(Location *test, const char *label);
+    Location *GetTest()             { return test; }
+    CondBranch *Negated(const char *label);
     void EmitSpecific(Mips *mips);
-    string getLabel();
+    void RenameUse(Location *from, Location *to);
+    List<Location*> GenSet();
+};
+
+  // Jumps if "op1 code op2" holds, where code is one of the comparisons
+  // Eq, Ne, Less, Le, Gt or Ge. op2 is NULL when comparing against the
+  // immediate instead.
+class IfCompare: public CondBranch {
+    Mips::OpCode code;
+    Location *op1, *op2;
+    int immediate;
+    void Describe();
+  public:
+    IfCompare(Mips::OpCode code, Location *op1, Location *op2, const char *label);
+    IfCompare(Mips::OpCode code, Location *op1, int immediate, const char *label);
+    Mips::OpCode GetOpCode()        { return code; }
+    Location *GetOp1()              { return op1; }
+    Location *GetOp2()              { return op2; }
+    int GetImmediate()              { return immediate; }
+    CondBranch *Negated(const char *label);
+    void EmitSpecific(Mips *mips);
+    void RenameUse(Location *from, Location *to);
     List<Location*> GenSet();
 };
 
 class BeginFunc: public Instruction {
     int frameSize;
-    List<Location*> parameters;
-    bool isMethod;
+    int outgoingSize;
+    unsigned int calleeSaved;
+    bool makesCalls, readsParamSlots;
+    void Describe();
   public:
     BeginFunc();
     // used to backpatch the instruction with frame size once known
     void SetFrameSize(int numBytesForAllLocalsAndTemps);
+    int GetFrameSize()              { return frameSize; }
+    // room for the stack arguments of the biggest call the function
+    // makes, reserved once below everything else in the frame
+    void SetOutgoingSize(int numBytesForArguments);
+    // the callee-saved registers the allocator used, which get slots
+    // of their own at the bottom of the frame
+    void SetCalleeSaved(unsigned int registerMask);
+    // what the body needs from the frame, for picking a minimal
+    // prologue: leaf functions don't save $ra, and ones that don't
+    // read parameters from the stack either may not need a frame
+    void SetFrameUse(bool makesCalls, bool readsParamSlots);
     void EmitSpecific(Mips *mips);
-    void addParameter(Location* param);
-    void checkMethod(FnDecl* fn);
 };
 
 class EndFunc: public Instruction {
@@ -252,43 +380,91 @@ class EndFunc: public Instruction {
 
 class Return: public Instruction {
     Location *val;
+    void Describe();
   public:
     Return(Location *val);
     void EmitSpecific(Mips *mips);
+    void RenameUse(Location *from, Location *to);
     List<Location*> GenSet();
 };   
 
+  // Stores an argument into its slot of the outgoing-argument area at
+  // the bottom of the caller's frame, offset bytes above $sp
 class PushParam: public Instruction {
     Location *param;
+    int offset;
+    void Describe();
   public:
-    PushParam(Location *param);
+    PushParam(Location *param, int offset);
     void EmitSpecific(Mips *mips);
+    void RenameUse(Location *from, Location *to);
     List<Location*> GenSet();
 }; 
 
-class PopParams: public Instruction {
-    int numBytes;
+  // Common part of LCall and ACall. The first arguments are passed in
+  // registers (the argRegs Locations, precolored to a0-a3): the call
+  // reads the ones it uses and, like any call, clobbers all of them.
+class CallInstr: public Instruction {
+  protected:
+    Location *dst;
+    List<Location*> argRegs;
+    int numArgRegs;
+    unsigned int clobbers;
+    virtual void Describe() = 0;
+    virtual void EmitCall(Mips *mips) = 0;
   public:
-    PopParams(int numBytesOfParamsToRemove);
+    CallInstr(Location *result) : dst(result), numArgRegs(0), clobbers(~0u) {}
+    void SetArgRegisters(List<Location*> *regs, int numUsed);
+    // mask of the registers the callee may change, all of them unless
+    // the callee is known
+    void SetClobbers(unsigned int registerMask) { clobbers = registerMask; }
+    unsigned int GetClobbers()                  { return clobbers; }
+    // the locations saved around the call (one per register)
+    List<Location*> LiveAcrossCall();
     void EmitSpecific(Mips *mips);
-}; 
+    void RenameDef(Location *from, Location *to);
+    List<Location*> GenSet();
+    List<Location*> KillSet();
+};
 
-class LCall: public Instruction {
+class LCall: public CallInstr {
     const char *label;
-    Location *dst;
+    void Describe();
+    void EmitCall(Mips *mips);
   public:
     LCall(const char *labe, Location *result);
-    void EmitSpecific(Mips *mips);
-    List<Location*> KillSet();
+    const char *getLabel() { return label; }
 };
 
-class ACall: public Instruction {
-    Location *dst, *methodAddr;
+class ACall: public CallInstr {
+    Location *methodAddr;
+    void Describe();
+    void EmitCall(Mips *mips);
   public:
     ACall(Location *meth, Location *result);
-    void EmitSpecific(Mips *mips);
+    void RenameUse(Location *from, Location *to);
     List<Location*> GenSet();
+};
+
+  // dst = phi(args): merges the values reaching a block. Only exists
+  // while a function is in SSA form, args[i] being the value that comes
+  // from the block's i-th predecessor.
+class Phi: public Instruction {
+    Location *dst;
+    List<Location*> args;
+    void Describe();
+  public:
+    Phi(Location *dst, int numPreds);
+    Location *GetDst()              { return dst; }
+    int NumArgs()                   { return args.NumElements(); }
+    Location *GetArg(int i)         { return args.Nth(i); }
+    void SetArg(int i, Location *arg);
+    void EmitSpecific(Mips *mips);
+    void RenameUse(Location *from, Location *to);
+    void RenameDef(Location *from, Location *to);
     List<Location*> KillSet();
+    List<Location*> GenSet();
+    bool isPure() { return true; }
 };
 
 class VTable: public Instruction {
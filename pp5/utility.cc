@@ -10,6 +10,9 @@
 #include "list.h"
 
 static List<const char*> debugKeys;
+static List<const char*> optionKeys;
+// the names -f<option> accepts; anything else gets the usage message
+static const char *knownOptions[] = { "omit-frame-pointer", NULL };
 static const int BufferSize = 2048;
 
 void Failure(const char *format, ...)
@@ -27,22 +30,22 @@ void Failure(const char *format, ...)
 
 
 
-int IndexOf(const char *key)
+static int IndexOf(List<const char*> &keys, const char *key)
 {
-   for (int i = 0; i < debugKeys.NumElements(); i++)
-      if (!strcmp(debugKeys.Nth(i), key)) return i;
+   for (int i = 0; i < keys.NumElements(); i++)
+      if (!strcmp(keys.Nth(i), key)) return i;
    return -1;
 }
 
 bool IsDebugOn(const char *key)
 {
-   return (IndexOf(key) != -1);
+   return (IndexOf(debugKeys, key) != -1);
 }
 
 
 void SetDebugForKey(const char *key, bool value)
 {
-  int k = IndexOf(key);
+  int k = IndexOf(debugKeys, key);
   if (!value && k != -1)
     debugKeys.RemoveAt(k);
   else if (value && k == -1)
@@ -51,6 +54,21 @@ void SetDebugForKey(const char *key, bool value)
 
 
 
+bool IsOptionOn(const char *key)
+{
+   return (IndexOf(optionKeys, key) != -1);
+}
+
+void SetOptionForKey(const char *key, bool value)
+{
+  int k = IndexOf(optionKeys, key);
+  if (!value && k != -1)
+    optionKeys.RemoveAt(k);
+  else if (value && k == -1)
+    optionKeys.Append(key);
+}
+
+
 void PrintDebug(const char *key, const char *format, ...)
 {
   va_list args;
@@ -66,17 +84,27 @@ void PrintDebug(const char *key, const char *format, ...)
 }
 
 
+static bool IsKnownOption(const char *key)
+{
+  for (int i = 0; knownOptions[i] != NULL; i++)
+    if (!strcmp(knownOptions[i], key)) return true;
+  return false;
+}
+
 void ParseCommandLine(int argc, char *argv[])
 {
-  if (argc == 1)
-    return;
-  
-  if (strcmp(argv[1], "-d") != 0) { // first arg is not -d
-    printf("Usage:   -d <debug-key-1> <debug-key-2> ... \n");
-    exit(2);
+  bool debugKeysFollow = false;
+  for (int i = 1; i < argc; i++) {
+    if (!strncmp(argv[i], "-f", 2) && IsKnownOption(argv[i] + 2))
+      SetOptionForKey(argv[i] + 2, true);
+    else if (!strcmp(argv[i], "-d"))
+      debugKeysFollow = true;
+    else if (debugKeysFollow && strncmp(argv[i], "-f", 2))
+      SetDebugForKey(argv[i], true);
+    else {
+      printf("Usage:   [-f<option> ...] [-d <debug-key-1> <debug-key-2> ...] \n");
+      exit(2);
+    }
   }
-
-  for (int i = 2; i < argc; i++)
-    SetDebugForKey(argv[i], true);
 }
 
@@ -72,11 +72,31 @@ bool IsDebugOn(const char *key);
 
 
 
+/* Function: IsOptionOn()
+ * Usage: if (IsOptionOn("omit-frame-pointer")) ...
+ * ------------------------------------------------
+ * Return true/false based on whether this code generation option was
+ * turned on (with -f<option> on the command line).
+ */
+bool IsOptionOn(const char *key);
+
+
+/* Function: SetOptionForKey()
+ * Usage: SetOptionForKey("omit-frame-pointer", true);
+ * ---------------------------------------------------
+ * Turn a code generation option on or off.
+ */
+void SetOptionForKey(const char *key, bool val);
+
+
+
 /* Function: ParseCommandLine
  * --------------------------
- * Turn on the debugging flags from the command line.  Verifies that
- * first argument is -d, and then interpret all the arguments that follow
- * as being flags to turn on.
+ * Turn on the options and debugging flags from the command line.
+ * Arguments of the form -f<option> turn on an option, and all the
+ * arguments following -d (other than options) are taken as debugging
+ * flags to turn on. An option the compiler doesn't know, like any
+ * other unexpected argument, prints the usage message and exits.
  */
 void ParseCommandLine(int argc, char *argv[]);
      